@@ -0,0 +1,393 @@
+﻿//окрема збірка для вимірювання швидкодії ядра редактора: увесь код програми підключається сюди, а її main вимикається
+#define EDITOR_BENCHMARK
+#include "../Program/Program.cpp"
+#include <psapi.h>
+#include <new>
+#include <cstdlib>
+
+class AllocationCounter {
+private:
+	static bool isCounting;
+	static unsigned long long countOfAllocations;
+	static unsigned long long countOfAllocatedBytes;
+
+public:
+	static void setCounting(bool isCounting) { AllocationCounter::isCounting = isCounting; }
+	static void reset() {
+		countOfAllocations = 0;
+		countOfAllocatedBytes = 0;
+	}
+	static void registerAllocation(size_t size) {
+		if (isCounting) {
+			countOfAllocations++;
+			countOfAllocatedBytes += size;
+		}
+	}
+	static unsigned long long getCountOfAllocations() { return countOfAllocations; }
+	static unsigned long long getCountOfAllocatedBytes() { return countOfAllocatedBytes; }
+};
+
+bool AllocationCounter::isCounting = false;
+unsigned long long AllocationCounter::countOfAllocations = 0;
+unsigned long long AllocationCounter::countOfAllocatedBytes = 0;
+
+//усі виділення пам'яті проходять через ці оператори, тож байти на операцію рахуються без зовнішніх інструментів
+void* operator new(size_t size) {
+	AllocationCounter::registerAllocation(size);
+	if (void* memory = std::malloc(size ? size : 1))
+		return memory;
+	throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, size_t) noexcept { std::free(memory); }
+
+//стан одного запуску: тіло бенчмарку саме готує дані, а вимірюється лише те, що між startTiming і stopTiming
+//(і не між pauseTiming та resumeTiming)
+class BenchmarkState {
+private:
+	size_t iterations;
+	std::chrono::steady_clock::time_point startOfInterval;
+	std::chrono::nanoseconds measuredTime;
+
+public:
+	BenchmarkState(size_t iterations) : iterations(iterations), measuredTime(0) { }
+
+	size_t getIterations() { return iterations; }
+	std::chrono::nanoseconds getMeasuredTime() { return measuredTime; }
+
+	void startTiming() {
+		AllocationCounter::reset();
+		measuredTime = std::chrono::nanoseconds(0);
+		resumeTiming();
+	}
+	void stopTiming() { pauseTiming(); }
+	void pauseTiming() {
+		AllocationCounter::setCounting(false);
+		measuredTime += std::chrono::steady_clock::now() - startOfInterval;
+	}
+	void resumeTiming() {
+		startOfInterval = std::chrono::steady_clock::now();
+		AllocationCounter::setCounting(true);
+	}
+};
+
+class BenchmarkRunner {
+private:
+	struct Benchmark {
+		std::string name;
+		std::function<void(BenchmarkState&)> body;
+		size_t maxIterations;
+	};
+
+	std::vector<Benchmark> benchmarks;
+	std::string filter; //запускаються лише бенчмарки, в імені яких є цей рядок
+	std::chrono::milliseconds minTime; //кількість ітерацій збільшується, доки вимір не триватиме щонайменше стільки
+
+	static size_t getPeakResidentBytes() {
+		PROCESS_MEMORY_COUNTERS counters;
+		if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+			return 0;
+		return counters.PeakWorkingSetSize;
+	}
+
+public:
+	BenchmarkRunner(std::string filter, std::chrono::milliseconds minTime) : filter(filter), minTime(minTime) { }
+
+	void add(std::string name, std::function<void(BenchmarkState&)> body, size_t maxIterations = 1000000) {
+		benchmarks.push_back({ name, body, maxIterations });
+	}
+
+	//результати - JSON-масив, по об'єкту на бенчмарк, щоб їх можна було порівнювати між версіями
+	void runAll(std::ostream& output) {
+		bool isFirstResult = true;
+
+		output << "[\n";
+		for (Benchmark& benchmark : benchmarks) {
+			if (benchmark.name.find(filter) == std::string::npos)
+				continue;
+
+			size_t iterations = 1;
+			BenchmarkState state(iterations);
+			while (true) {
+				state = BenchmarkState(iterations);
+				benchmark.body(state);
+				if (state.getMeasuredTime() >= minTime || iterations >= benchmark.maxIterations)
+					break;
+				iterations = std::min(benchmark.maxIterations, iterations * 10);
+			}
+
+			double nanosecondsPerOperation = (double)state.getMeasuredTime().count() / iterations;
+			double bytesPerOperation = (double)AllocationCounter::getCountOfAllocatedBytes() / iterations;
+			double allocationsPerOperation = (double)AllocationCounter::getCountOfAllocations() / iterations;
+
+			output << (isFirstResult ? "" : ",\n");
+			output << "  {\"name\": \"" << benchmark.name << "\", \"iterations\": " << iterations;
+			output << ", \"ns_per_op\": " << nanosecondsPerOperation << ", \"bytes_per_op\": " << bytesPerOperation;
+			output << ", \"allocs_per_op\": " << allocationsPerOperation << ", \"peak_rss_bytes\": " << getPeakResidentBytes() << "}";
+			output.flush();
+			isFirstResult = false;
+		}
+		output << "\n]\n";
+	}
+};
+
+class EditorBenchmarks {
+private:
+	static const std::string SCRATCH_DIRECTORY; //тимчасова робоча тека, щоб журнали бенчмарків не змішувались з сеансами користувача
+	static const std::string TEXT_TO_PASTE;
+
+	static std::string makeDocument(size_t size) {
+		std::string document;
+		document.reserve(size);
+		for (size_t i = 0; document.size() < size; i++)
+			document += (i % 64 == 63) ? '\n' : (char)('a' + i % 26);
+		return document;
+	}
+	static std::string describeSize(size_t size) {
+		if (size >= 1024 * 1024)
+			return std::to_string(size / (1024 * 1024)) + "MB";
+		return std::to_string(size / 1024) + "KB";
+	}
+	static Session* createSession(Editor* editor, std::string name, bool shouldOpenJournal) {
+		Session* session = new Session();
+		session->setName(name);
+		editor->getSessionsHistory()->addSessionToEnd(session);
+		if (shouldOpenJournal)
+			FilesManager::openSessionJournal(session);
+		editor->setCurrentSession(session);
+		return session;
+	}
+	static int getPositionInDocument(std::string place, size_t sizeOfDocument) {
+		if (place == "start")
+			return 0;
+		return place == "middle" ? sizeOfDocument / 2 : sizeOfDocument - 1;
+	}
+
+	//вставка, вирізання та видалення в документі заданого розміру; зміна відкочується поза виміром, тож розмір документа не змінюється
+	static void addEditorOperations(BenchmarkRunner& runner, Editor* editor, size_t sizeOfDocument) {
+		std::shared_ptr<TextBuffer> document = std::make_shared<TextBuffer>(makeDocument(sizeOfDocument));
+
+		for (std::string place : { "start", "middle", "end" }) {
+			runner.add("editor/paste/" + place + "/" + describeSize(sizeOfDocument), [editor, document, place](BenchmarkState& state) {
+				Session* session = createSession(editor, "paste", false);
+				state.startTiming();
+				for (size_t i = 0; i < state.getIterations(); i++) {
+					int position = getPositionInDocument(place, document->size());
+					TextDelta delta = editor->paste(document.get(), position, position, TEXT_TO_PASTE);
+					state.pauseTiming();
+					delta.revertOn(document.get());
+					state.resumeTiming();
+				}
+				state.stopTiming();
+				editor->getSessionsHistory()->deleteSession(session);
+				});
+
+			for (std::string operation : { "cut", "remove" })
+				runner.add("editor/" + operation + "/" + place + "/" + describeSize(sizeOfDocument), [editor, document, place, operation](BenchmarkState& state) {
+					Session* session = createSession(editor, operation, false);
+					state.startTiming();
+					for (size_t i = 0; i < state.getIterations(); i++) {
+						int start = std::min<size_t>(getPositionInDocument(place, document->size()), document->size() - TEXT_TO_PASTE.size());
+						TextDelta delta = operation == "cut" ? editor->cut(document.get(), start, start + TEXT_TO_PASTE.size() - 1) :
+							editor->remove(document.get(), start, start + TEXT_TO_PASTE.size() - 1);
+						state.pauseTiming();
+						delta.revertOn(document.get());
+						state.resumeTiming();
+					}
+					state.stopTiming();
+					editor->getSessionsHistory()->deleteSession(session);
+					});
+		}
+	}
+	//виклик команди через менеджер разом з копією команди, що кладеться в історію, і (за потреби) записом у журнал;
+	//вставка скасовується поза виміром, тож кожна ітерація працює з документом того ж розміру
+	static void addCommandsManagerOperations(BenchmarkRunner& runner, Editor* editor, CommandsManager* commandsManager) {
+		for (bool shouldOpenJournal : { false, true })
+			runner.add(std::string("commands-manager/invoke-paste/") + (shouldOpenJournal ? "with-journal" : "in-memory"),
+				[editor, commandsManager, shouldOpenJournal](BenchmarkState& state) {
+					TextBuffer* text = new TextBuffer(makeDocument(64 * 1024));
+					editor->setCurrentText(text);
+					Session* session = createSession(editor, "invoke", shouldOpenJournal);
+
+					state.startTiming();
+					for (size_t i = 0; i < state.getIterations(); i++) {
+						commandsManager->invokeCommand(CommandType::Paste, text->size() - 1, text->size() - 1, TEXT_TO_PASTE);
+						state.pauseTiming();
+						commandsManager->invokeCommand(CommandType::Undo);
+						state.resumeTiming();
+					}
+					state.stopTiming();
+
+					FilesManager::deleteSessionJournal(editor->getSessionsHistory()->deleteSession(session));
+					editor->setCurrentText(nullptr);
+					delete text;
+				}, 200000);
+	}
+	//ланцюжок скасувань до початку історії, а потім повторень до її кінця
+	static void addUndoRedoOperations(BenchmarkRunner& runner, Editor* editor, CommandsManager* commandsManager, int sizeOfHistory) {
+		runner.add("history/undo-redo-chain/" + std::to_string(sizeOfHistory) + "-commands", [editor, commandsManager, sizeOfHistory](BenchmarkState& state) {
+			TextBuffer* text = new TextBuffer(makeDocument(64 * 1024));
+			editor->setCurrentText(text);
+			Session* session = createSession(editor, "undo-redo", false);
+			for (int i = 0; i < sizeOfHistory; i++)
+				commandsManager->invokeCommand(CommandType::Paste, i * 7 % text->size(), i * 7 % text->size() + 1, TEXT_TO_PASTE);
+
+			bool isUndoing = true;
+			state.startTiming();
+			for (size_t i = 0; i < state.getIterations(); i++) {
+				if (isUndoing && session->getCurIndexInCommHistory() == -1)
+					isUndoing = false;
+				else if (!isUndoing && !commandsManager->isThereAnyCommandForward())
+					isUndoing = true;
+				commandsManager->invokeCommand(isUndoing ? CommandType::Undo : CommandType::Redo);
+			}
+			state.stopTiming();
+
+			editor->getSessionsHistory()->deleteSession(session);
+			editor->setCurrentText(nullptr);
+			delete text;
+			});
+	}
+	//завантаження великої історії з журналу: одна операція - повне відтворення журналу сеансу
+	static void addPersistenceOperations(BenchmarkRunner& runner, Editor* editor, CommandsManager* commandsManager, int sizeOfHistory) {
+		runner.add("journal/load-history/" + std::to_string(sizeOfHistory) + "-records", [editor, commandsManager, sizeOfHistory](BenchmarkState& state) {
+			TextBuffer* text = new TextBuffer(makeDocument(64 * 1024));
+			editor->setCurrentText(text);
+			Session* session = createSession(editor, "journal", true);
+			for (int i = 0; i < sizeOfHistory; i++)
+				commandsManager->invokeCommand(CommandType::Paste, i * 7 % text->size(), i * 7 % text->size() + 1, TEXT_TO_PASTE);
+
+			state.startTiming();
+			for (size_t i = 0; i < state.getIterations(); i++) {
+				state.pauseTiming();
+				session->unloadHistory();
+				state.resumeTiming();
+				FilesManager::loadSessionHistory(editor, session);
+			}
+			state.stopTiming();
+
+			FilesManager::deleteSessionJournal(editor->getSessionsHistory()->deleteSession(session));
+			editor->setCurrentText(nullptr);
+			delete text;
+			}, 1000);
+	}
+	//пошук серед тисяч сеансів за іменем, за позицією та за початком імені
+	static void addSessionsHistoryOperations(BenchmarkRunner& runner, int countOfSessions) {
+		std::shared_ptr<SessionsHistory> sessionsHistory = std::make_shared<SessionsHistory>();
+		for (int i = 0; i < countOfSessions; i++) {
+			Session* session = new Session();
+			session->setName("session-" + std::to_string(i * 7919 % countOfSessions));
+			sessionsHistory->addSessionToEnd(session);
+		}
+		std::string suffix = "/" + std::to_string(countOfSessions) + "-sessions";
+
+		runner.add("sessions-history/get-by-name" + suffix, [sessionsHistory, countOfSessions](BenchmarkState& state) {
+			state.startTiming();
+			for (size_t i = 0; i < state.getIterations(); i++)
+				sessionsHistory->getSessionByName("session-" + std::to_string(i % countOfSessions));
+			state.stopTiming();
+			});
+		runner.add("sessions-history/get-by-index" + suffix, [sessionsHistory, countOfSessions](BenchmarkState& state) {
+			state.startTiming();
+			for (size_t i = 0; i < state.getIterations(); i++)
+				sessionsHistory->getSessionByIndex(i * 31 % countOfSessions);
+			state.stopTiming();
+			});
+		runner.add("sessions-history/get-by-prefix" + suffix, [sessionsHistory, countOfSessions](BenchmarkState& state) {
+			state.startTiming();
+			for (size_t i = 0; i < state.getIterations(); i++)
+				sessionsHistory->getSessionsByPrefix("session-" + std::to_string(i % 10));
+			state.stopTiming();
+			}, 100000);
+		runner.add("sessions-history/add-and-delete" + suffix, [sessionsHistory](BenchmarkState& state) {
+			state.startTiming();
+			for (size_t i = 0; i < state.getIterations(); i++) {
+				Session* session = new Session();
+				session->setName("temporary-" + std::to_string(i));
+				sessionsHistory->addSessionToEnd(session);
+				sessionsHistory->deleteSessionByIndex(sessionsHistory->size() - 1);
+			}
+			state.stopTiming();
+			});
+	}
+
+	template <typename Number>
+	static bool parseNumber(std::string_view text, Number& number) {
+		auto result = std::from_chars(text.data(), text.data() + text.size(), number);
+		return result.ec == std::errc() && result.ptr == text.data() + text.size() && !text.empty();
+	}
+	static int printUsage(std::string error) {
+		std::cerr << error << "\n"
+			<< "usage: Benchmark [--filter <substring>] [--output <file>] [--max-size <bytes>] [--min-time-ms <ms>]\n";
+		return 2;
+	}
+
+public:
+	static int run(int argc, char* argv[]) {
+		std::string filter, outputFilepath;
+		size_t maxSizeOfDocument = 100 * 1024 * 1024;
+		long long minTimeInMilliseconds = 200;
+
+		//невідомий параметр, параметр без значення чи нечислове значення зупиняють запуск, щоб вимірювання не йшли з іншими налаштуваннями
+		for (int i = 1; i < argc; i += 2) {
+			std::string option = argv[i];
+			if (option != "--filter" && option != "--output" && option != "--max-size" && option != "--min-time-ms")
+				return printUsage("unknown option: " + option);
+			if (i + 1 == argc)
+				return printUsage("missing value for " + option);
+
+			std::string value = argv[i + 1];
+			if (option == "--filter")
+				filter = value;
+			else if (option == "--output")
+				outputFilepath = value;
+			else if (option == "--max-size" && !parseNumber(value, maxSizeOfDocument))
+				return printUsage("invalid value for --max-size: " + value);
+			else if (option == "--min-time-ms" && (!parseNumber(value, minTimeInMilliseconds) || minTimeInMilliseconds < 0))
+				return printUsage("invalid value for --min-time-ms: " + value);
+		}
+
+		std::filesystem::path workingDirectory = std::filesystem::current_path();
+		std::filesystem::create_directories(SCRATCH_DIRECTORY);
+		std::filesystem::current_path(SCRATCH_DIRECTORY);
+
+		Editor* editor = new Editor();
+		CommandsManager* commandsManager = new CommandsManager(editor);
+		BenchmarkRunner runner(filter, std::chrono::milliseconds(minTimeInMilliseconds));
+
+		for (size_t sizeOfDocument : { 1024ull, 64ull * 1024, 1024ull * 1024, 16ull * 1024 * 1024, 100ull * 1024 * 1024 })
+			if (sizeOfDocument <= maxSizeOfDocument)
+				addEditorOperations(runner, editor, sizeOfDocument);
+		addCommandsManagerOperations(runner, editor, commandsManager);
+		addUndoRedoOperations(runner, editor, commandsManager, 10000);
+		addPersistenceOperations(runner, editor, commandsManager, 10000);
+		addPersistenceOperations(runner, editor, commandsManager, 100000);
+		addSessionsHistoryOperations(runner, 1000);
+		addSessionsHistoryOperations(runner, 10000);
+
+		if (outputFilepath.empty())
+			runner.runAll(std::cout);
+		else {
+			std::ofstream output(workingDirectory / outputFilepath);
+			runner.runAll(output);
+		}
+
+		delete commandsManager;
+		delete editor;
+		std::filesystem::current_path(workingDirectory);
+		std::filesystem::remove_all(SCRATCH_DIRECTORY);
+		return 0;
+	}
+};
+
+const std::string EditorBenchmarks::SCRATCH_DIRECTORY = "BenchmarkScratch";
+const std::string EditorBenchmarks::TEXT_TO_PASTE = "benchmark text!\n";
+
+//Benchmark [--filter <частина імені>] [--output <файл>] [--max-size <байтів>] [--min-time-ms <мс>]
+int main(int argc, char* argv[])
+{
+	return EditorBenchmarks::run(argc, argv);
+}
@@ -2,38 +2,2863 @@
 #include <fstream>
 #include <filesystem>
 #include <stack>
+#include <deque>
 #include <functional>
+#include <memory>
+#include <vector>
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include <windows.h>
+#include <conio.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define EDITOR_HAS_X86_SIMD
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define EDITOR_TARGET_AVX2
+#else
+#define EDITOR_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+class ByteScanner {
+private:
+#ifdef EDITOR_HAS_X86_SIMD
+	EDITOR_TARGET_AVX2 static size_t findAvx2(const char* data, size_t length, char byte) {
+		__m256i pattern = _mm256_set1_epi8(byte);
+		size_t i = 0;
+		for (; i + 32 <= length; i += 32) {
+			unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i)), pattern));
+			if (mask)
+				return i + lowestSetBit(mask);
+		}
+		return i + findScalar(data + i, length - i, byte);
+	}
+	EDITOR_TARGET_AVX2 static size_t countAvx2(const char* data, size_t length, char byte) {
+		__m256i pattern = _mm256_set1_epi8(byte);
+		size_t i = 0, count = 0;
+		for (; i + 32 <= length; i += 32)
+			count += popcount((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i)), pattern)));
+		return count + countScalar(data + i, length - i, byte);
+	}
+	static size_t findSse2(const char* data, size_t length, char byte) {
+		__m128i pattern = _mm_set1_epi8(byte);
+		size_t i = 0;
+		for (; i + 16 <= length; i += 16) {
+			unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i)), pattern));
+			if (mask)
+				return i + lowestSetBit(mask);
+		}
+		return i + findScalar(data + i, length - i, byte);
+	}
+	static size_t countSse2(const char* data, size_t length, char byte) {
+		__m128i pattern = _mm_set1_epi8(byte);
+		size_t i = 0, count = 0;
+		for (; i + 16 <= length; i += 16)
+			count += popcount((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i)), pattern)));
+		return count + countScalar(data + i, length - i, byte);
+	}
+#endif
+
+	static size_t findScalar(const char* data, size_t length, char byte) {
+		const void* found = memchr(data, byte, length);
+		return found ? (const char*)found - data : length;
+	}
+	static size_t countScalar(const char* data, size_t length, char byte) {
+		size_t count = 0;
+		for (size_t i = 0; i < length; i++)
+			count += data[i] == byte;
+		return count;
+	}
+
+public:
+#ifdef EDITOR_HAS_X86_SIMD
+	static bool isAvx2Supported() {
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		__cpuid(info, 1);
+		bool isOsSavingAvxState = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+		if (!isOsSavingAvxState)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+	static bool useAvx2() {
+		static const bool isSupported = isAvx2Supported();
+		return isSupported;
+	}
+#endif
+	static unsigned lowestSetBit(unsigned mask) {
+		unsigned index = 0;
+		while (!(mask & 1)) {
+			mask >>= 1;
+			index++;
+		}
+		return index;
+	}
+	static unsigned popcount(unsigned mask) {
+		unsigned count = 0;
+		for (; mask; mask &= mask - 1)
+			count++;
+		return count;
+	}
+
+	//повертає позицію першого входження byte або length, якщо його немає
+	static size_t find(const char* data, size_t length, char byte) {
+#ifdef EDITOR_HAS_X86_SIMD
+		return useAvx2() ? findAvx2(data, length, byte) : findSse2(data, length, byte);
+#else
+		return findScalar(data, length, byte);
+#endif
+	}
+	static size_t count(const char* data, size_t length, char byte) {
+#ifdef EDITOR_HAS_X86_SIMD
+		return useAvx2() ? countAvx2(data, length, byte) : countSse2(data, length, byte);
+#else
+		return countScalar(data, length, byte);
+#endif
+	}
+};
+
+//UTF-8: перевірка, підрахунок символів і розбір. ASCII, з якого складається більшість тексту, пропускається векторно,
+//а з AVX2 перевіряються векторно й багатобайтові послідовності: кожна пара сусідніх байтів класифікується трьома таблицями
+//за старшими і молодшими півбайтами, як у простому валідаторі Кейзера і Лемира, тож кириличний текст не розбирається побайтово
+class Utf8 {
+private:
+#ifdef EDITOR_HAS_X86_SIMD
+	//ознаки помилок, які може дати пара байтів (попередній, поточний)
+	static const uint8_t TOO_SHORT = 1 << 0, TOO_LONG = 1 << 1, OVERLONG_3 = 1 << 2, TOO_LARGE = 1 << 3, SURROGATE = 1 << 4,
+		OVERLONG_2 = 1 << 5, TOO_LARGE_1000 = 1 << 6, OVERLONG_4 = 1 << 6, TWO_CONTINUATIONS = 1 << 7,
+		CARRY = TOO_SHORT | TOO_LONG | TWO_CONTINUATIONS;
+
+	EDITOR_TARGET_AVX2 static __m256i lookup(__m256i nibbles, const uint8_t* table) {
+		return _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)table)), nibbles);
+	}
+	//байти input, зсунуті на count позицій назад, з останніми байтами попереднього блоку на початку
+	template<int count>
+	EDITOR_TARGET_AVX2 static __m256i previous(__m256i input, __m256i previousInput) {
+		return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(previousInput, input, 0x21), 16 - count);
+	}
+	EDITOR_TARGET_AVX2 static __m256i errorsOfBlock(__m256i input, __m256i previousInput) {
+		static const uint8_t FIRST_HIGH[16] = { TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+			TWO_CONTINUATIONS, TWO_CONTINUATIONS, TWO_CONTINUATIONS, TWO_CONTINUATIONS, TOO_SHORT | OVERLONG_2, TOO_SHORT,
+			TOO_SHORT | OVERLONG_3 | SURROGATE, TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4 };
+		static const uint8_t FIRST_LOW[16] = { CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, CARRY | OVERLONG_2, CARRY, CARRY,
+			CARRY | TOO_LARGE, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+			CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+			CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+			CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000 };
+		static const uint8_t SECOND_HIGH[16] = { TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+			TOO_LONG | OVERLONG_2 | TWO_CONTINUATIONS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+			TOO_LONG | OVERLONG_2 | TWO_CONTINUATIONS | OVERLONG_3 | TOO_LARGE,
+			TOO_LONG | OVERLONG_2 | TWO_CONTINUATIONS | SURROGATE | TOO_LARGE, TOO_LONG | OVERLONG_2 | TWO_CONTINUATIONS | SURROGATE | TOO_LARGE,
+			TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT };
+
+		__m256i lowNibble = _mm256_set1_epi8(0x0F);
+		__m256i previous1 = previous<1>(input, previousInput);
+		__m256i specialCases = _mm256_and_si256(_mm256_and_si256(
+			lookup(_mm256_and_si256(_mm256_srli_epi16(previous1, 4), lowNibble), FIRST_HIGH),
+			lookup(_mm256_and_si256(previous1, lowNibble), FIRST_LOW)),
+			lookup(_mm256_and_si256(_mm256_srli_epi16(input, 4), lowNibble), SECOND_HIGH));
+
+		//третій і четвертий байти послідовностей мають бути продовженнями, а таблиці бачать лише пари байтів
+		__m256i isThirdByte = _mm256_subs_epu8(previous<2>(input, previousInput), _mm256_set1_epi8((char)(0xE0 - 0x80)));
+		__m256i isFourthByte = _mm256_subs_epu8(previous<3>(input, previousInput), _mm256_set1_epi8((char)(0xF0 - 0x80)));
+		__m256i mustBeContinuation = _mm256_and_si256(_mm256_or_si256(isThirdByte, isFourthByte), _mm256_set1_epi8((char)0x80));
+		return _mm256_xor_si256(mustBeContinuation, specialCases);
+	}
+	//ненульове, якщо блок закінчується незавершеною послідовністю
+	EDITOR_TARGET_AVX2 static __m256i incompleteOfBlock(__m256i input) {
+		static const uint8_t MAX_VALUES[32] = { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+			255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1 };
+		return _mm256_subs_epu8(input, _mm256_loadu_si256((const __m256i*)MAX_VALUES));
+	}
+	EDITOR_TARGET_AVX2 static bool isValidAvx2(const char* data, size_t length) {
+		__m256i error = _mm256_setzero_si256(), previousInput = _mm256_setzero_si256(), previousIncomplete = _mm256_setzero_si256();
+		size_t i = 0;
+		for (; i + 32 <= length; i += 32) {
+			__m256i input = _mm256_loadu_si256((const __m256i*)(data + i));
+			if (_mm256_movemask_epi8(input) == 0)
+				error = _mm256_or_si256(error, previousIncomplete);
+			else {
+				error = _mm256_or_si256(error, errorsOfBlock(input, previousInput));
+				previousIncomplete = incompleteOfBlock(input);
+			}
+			previousInput = input;
+		}
+		if (!_mm256_testz_si256(error, error))
+			return false;
+
+		//хвіст перевіряється з початку послідовності, яку міг розірвати кінець останнього повного блоку
+		size_t start = i;
+		while (start > 0 && i - start < 3 && isContinuation(data[start - 1]))
+			start--;
+		if (start > 0 && (unsigned char)data[start - 1] >= 0xC0)
+			start--;
+		return isValidScalar(data + start, length - start);
+	}
+	EDITOR_TARGET_AVX2 static size_t lengthOfAsciiAvx2(const char* data, size_t length) {
+		size_t i = 0;
+		for (; i + 32 <= length; i += 32) {
+			unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*)(data + i)));
+			if (mask)
+				return i + ByteScanner::lowestSetBit(mask);
+		}
+		return i + lengthOfAsciiScalar(data + i, length - i);
+	}
+	//байти продовження 10xxxxxx як знакові числа лежать від -128 до -65, а всі інші байти починають символ
+	EDITOR_TARGET_AVX2 static size_t countCodepointsAvx2(const char* data, size_t length) {
+		__m256i lastContinuation = _mm256_set1_epi8(-65);
+		size_t i = 0, count = 0;
+		for (; i + 32 <= length; i += 32)
+			count += ByteScanner::popcount((unsigned)_mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_loadu_si256((const __m256i*)(data + i)), lastContinuation)));
+		return count + countCodepointsScalar(data + i, length - i);
+	}
+	static size_t lengthOfAsciiSse2(const char* data, size_t length) {
+		size_t i = 0;
+		for (; i + 16 <= length; i += 16) {
+			unsigned mask = (unsigned)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(data + i)));
+			if (mask)
+				return i + ByteScanner::lowestSetBit(mask);
+		}
+		return i + lengthOfAsciiScalar(data + i, length - i);
+	}
+	static size_t countCodepointsSse2(const char* data, size_t length) {
+		__m128i lastContinuation = _mm_set1_epi8(-65);
+		size_t i = 0, count = 0;
+		for (; i + 16 <= length; i += 16)
+			count += ByteScanner::popcount((unsigned)_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_loadu_si128((const __m128i*)(data + i)), lastContinuation)));
+		return count + countCodepointsScalar(data + i, length - i);
+	}
+#endif
+
+	static size_t lengthOfAsciiScalar(const char* data, size_t length) {
+		size_t i = 0;
+		while (i < length && (unsigned char)data[i] < 0x80)
+			i++;
+		return i;
+	}
+	static size_t countCodepointsScalar(const char* data, size_t length) {
+		size_t count = 0;
+		for (size_t i = 0; i < length; i++)
+			count += !isContinuation(data[i]);
+		return count;
+	}
+	static bool isValidScalar(const char* data, size_t length) {
+		for (size_t i = 0; i < length;) {
+			i += lengthOfAscii(data + i, length - i);
+			if (i == length)
+				return true;
+			size_t lengthOfSequence;
+			if (decode(data + i, length - i, lengthOfSequence) == INVALID)
+				return false;
+			i += lengthOfSequence;
+		}
+		return true;
+	}
+
+public:
+	static const uint32_t INVALID = 0xFFFFFFFF;
+
+	static bool isContinuation(char byte) { return ((unsigned char)byte & 0xC0) == 0x80; }
+
+	//довжина ASCII-префікса data
+	static size_t lengthOfAscii(const char* data, size_t length) {
+#ifdef EDITOR_HAS_X86_SIMD
+		return ByteScanner::useAvx2() ? lengthOfAsciiAvx2(data, length) : lengthOfAsciiSse2(data, length);
+#else
+		return lengthOfAsciiScalar(data, length);
+#endif
+	}
+	static bool isValid(const char* data, size_t length) {
+#ifdef EDITOR_HAS_X86_SIMD
+		if (ByteScanner::useAvx2())
+			return isValidAvx2(data, length);
+#endif
+		return isValidScalar(data, length);
+	}
+	//кількість байтів, які починають символ; для коректного UTF-8 це кількість символів
+	static size_t countCodepoints(const char* data, size_t length) {
+#ifdef EDITOR_HAS_X86_SIMD
+		return ByteScanner::useAvx2() ? countCodepointsAvx2(data, length) : countCodepointsSse2(data, length);
+#else
+		return countCodepointsScalar(data, length);
+#endif
+	}
+
+	//розбирає символ на початку data; для некоректної послідовності повертає INVALID і довжину 1
+	static uint32_t decode(const char* data, size_t length, size_t& lengthOfSequence) {
+		const unsigned char* bytes = (const unsigned char*)data;
+		uint32_t codepoint, minimum;
+		lengthOfSequence = 1;
+		if (bytes[0] < 0x80)
+			return bytes[0];
+		if (bytes[0] >= 0xC2 && bytes[0] <= 0xDF) {
+			lengthOfSequence = 2;
+			codepoint = bytes[0] & 0x1F;
+			minimum = 0x80;
+		}
+		else if (bytes[0] >= 0xE0 && bytes[0] <= 0xEF) {
+			lengthOfSequence = 3;
+			codepoint = bytes[0] & 0x0F;
+			minimum = 0x800;
+		}
+		else if (bytes[0] >= 0xF0 && bytes[0] <= 0xF4) {
+			lengthOfSequence = 4;
+			codepoint = bytes[0] & 0x07;
+			minimum = 0x10000;
+		}
+		else
+			return INVALID;
+
+		if (lengthOfSequence > length) {
+			lengthOfSequence = 1;
+			return INVALID;
+		}
+		for (size_t i = 1; i < lengthOfSequence; i++) {
+			if (!isContinuation(data[i])) {
+				lengthOfSequence = 1;
+				return INVALID;
+			}
+			codepoint = codepoint << 6 | (bytes[i] & 0x3F);
+		}
+		if (codepoint < minimum || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF)) {
+			lengthOfSequence = 1;
+			return INVALID;
+		}
+		return codepoint;
+	}
+	static void encode(uint32_t codepoint, std::string& output) {
+		if (codepoint < 0x80)
+			output += (char)codepoint;
+		else if (codepoint < 0x800) {
+			output += (char)(0xC0 | codepoint >> 6);
+			output += (char)(0x80 | (codepoint & 0x3F));
+		}
+		else if (codepoint < 0x10000) {
+			output += (char)(0xE0 | codepoint >> 12);
+			output += (char)(0x80 | (codepoint >> 6 & 0x3F));
+			output += (char)(0x80 | (codepoint & 0x3F));
+		}
+		else {
+			output += (char)(0xF0 | codepoint >> 18);
+			output += (char)(0x80 | (codepoint >> 12 & 0x3F));
+			output += (char)(0x80 | (codepoint >> 6 & 0x3F));
+			output += (char)(0x80 | (codepoint & 0x3F));
+		}
+	}
+};
+
+//перетворення між Windows-1251, в якій працює консоль, і UTF-8; ASCII копіюється цілими фрагментами
+class Cp1251 {
+private:
+	static const uint16_t CODEPOINTS[128]; //символи Unicode для байтів 0x80-0xFF
+
+	static const std::unordered_map<uint32_t, char>& bytesOfCodepoints() {
+		static const std::unordered_map<uint32_t, char> bytes = []() {
+			std::unordered_map<uint32_t, char> result;
+			for (unsigned i = 0; i < 128; i++)
+				result[CODEPOINTS[i]] = (char)(0x80 + i);
+			return result;
+		}();
+		return bytes;
+	}
+
+public:
+	static void appendAsUtf8(const char* data, size_t length, std::string& output) {
+		for (size_t i = 0; i < length;) {
+			size_t lengthOfAscii = Utf8::lengthOfAscii(data + i, length - i);
+			output.append(data + i, lengthOfAscii);
+			i += lengthOfAscii;
+			if (i < length)
+				Utf8::encode(CODEPOINTS[(unsigned char)data[i++] - 0x80], output);
+		}
+	}
+	static std::string toUtf8(std::string_view text) {
+		std::string result;
+		result.reserve(text.size());
+		appendAsUtf8(text.data(), text.size(), result);
+		return result;
+	}
+	//символи, яких немає у Windows-1251, і некоректні байти стають '?'; повертає, чи перетворення було без втрат
+	static bool appendFromUtf8(const char* data, size_t length, std::string& output) {
+		const std::unordered_map<uint32_t, char>& bytes = bytesOfCodepoints();
+		bool isLossless = true;
+		for (size_t i = 0; i < length;) {
+			size_t lengthOfAscii = Utf8::lengthOfAscii(data + i, length - i);
+			output.append(data + i, lengthOfAscii);
+			i += lengthOfAscii;
+			if (i == length)
+				break;
+
+			size_t lengthOfSequence;
+			auto byte = bytes.find(Utf8::decode(data + i, length - i, lengthOfSequence));
+			isLossless = isLossless && byte != bytes.end();
+			output += byte != bytes.end() ? byte->second : '?';
+			i += lengthOfSequence;
+		}
+		return isLossless;
+	}
+	static std::string fromUtf8(std::string_view text) {
+		std::string result;
+		result.reserve(text.size());
+		appendFromUtf8(text.data(), text.size(), result);
+		return result;
+	}
+};
+
+//0x98 у Windows-1251 не визначений і відображається сам на себе
+const uint16_t Cp1251::CODEPOINTS[128] = {
+	0x0402, 0x0403, 0x201A, 0x0453, 0x201E, 0x2026, 0x2020, 0x2021, 0x20AC, 0x2030, 0x0409, 0x2039, 0x040A, 0x040C, 0x040B, 0x040F,
+	0x0452, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014, 0x0098, 0x2122, 0x0459, 0x203A, 0x045A, 0x045C, 0x045B, 0x045F,
+	0x00A0, 0x040E, 0x045E, 0x0408, 0x00A4, 0x0490, 0x00A6, 0x00A7, 0x0401, 0x00A9, 0x0404, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x0407,
+	0x00B0, 0x00B1, 0x0406, 0x0456, 0x0491, 0x00B5, 0x00B6, 0x00B7, 0x0451, 0x2116, 0x0454, 0x00BB, 0x0458, 0x0405, 0x0455, 0x0457,
+	0x0410, 0x0411, 0x0412, 0x0413, 0x0414, 0x0415, 0x0416, 0x0417, 0x0418, 0x0419, 0x041A, 0x041B, 0x041C, 0x041D, 0x041E, 0x041F,
+	0x0420, 0x0421, 0x0422, 0x0423, 0x0424, 0x0425, 0x0426, 0x0427, 0x0428, 0x0429, 0x042A, 0x042B, 0x042C, 0x042D, 0x042E, 0x042F,
+	0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437, 0x0438, 0x0439, 0x043A, 0x043B, 0x043C, 0x043D, 0x043E, 0x043F,
+	0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447, 0x0448, 0x0449, 0x044A, 0x044B, 0x044C, 0x044D, 0x044E, 0x044F
+};
+
+enum class TextEncoding : unsigned char { Cp1251, Utf8 };
+
+//необов'язкове трасування для аналізу зависань: кожен потік пише події у власний буфер без блокувань, а при завершенні
+//всі буфери записуються у форматі Chrome Trace Event, який відкривається в chrome://tracing або Perfetto.
+//Поки трасування вимкнене, подія коштує лише одну перевірку атомарного прапорця
+class Tracer {
+private:
+	struct Event {
+		const char* name; //лише рядкові літерали: вони живуть до кінця програми
+		uint64_t start, end; //наносекунди від увімкнення трасування
+	};
+	static const size_t COUNT_OF_EVENTS_IN_SEGMENT = 4096, MAX_COUNT_OF_SEGMENTS = 256;
+	//буфер потоку - список сегментів, які дописує лише сам потік; лічильник публікується з release, тож читач з acquire
+	//бачить усі події до нього
+	struct Segment {
+		Event events[COUNT_OF_EVENTS_IN_SEGMENT];
+		std::atomic<size_t> count{ 0 };
+		std::atomic<Segment*> next{ nullptr };
+	};
+	struct ThreadBuffer {
+		unsigned id;
+		std::atomic<const char*> name{ nullptr };
+		Segment* first = new Segment();
+		Segment* last = first;
+		size_t countOfSegments = 1;
+		std::atomic<size_t> countOfDropped{ 0 }; //події, що не вмістились у буфер
+		bool isThreadFinished = false; //під lockOfBuffers: після запису файлу буфер можна звільнити
+
+		~ThreadBuffer() {
+			for (Segment* segment = first; segment;) {
+				Segment* next = segment->next.load(std::memory_order_relaxed);
+				delete segment;
+				segment = next;
+			}
+		}
+	};
+	//буфер живе довше за свій потік, доки його події не записані у файл, тож потік лише позначає його завершеним
+	struct OwnerOfBuffer {
+		ThreadBuffer* buffer = nullptr;
+
+		~OwnerOfBuffer() {
+			if (!buffer)
+				return;
+			std::lock_guard<std::mutex> guard(lockOfBuffers);
+			buffer->isThreadFinished = true;
+		}
+	};
+
+	static std::atomic<bool> isEnabled;
+	static std::chrono::steady_clock::time_point origin;
+	static std::mutex lockOfBuffers; //лише для реєстрації і завершення потоку та для запису файлу
+	static std::vector<ThreadBuffer*> buffers;
+	static unsigned lastIdOfThread; //буфери завершених потоків видаляються, тож номер не береться з розміру списку
+
+	static ThreadBuffer* bufferOfThisThread() {
+		thread_local OwnerOfBuffer owner;
+		if (!owner.buffer) {
+			owner.buffer = new ThreadBuffer();
+			std::lock_guard<std::mutex> guard(lockOfBuffers);
+			owner.buffer->id = ++lastIdOfThread;
+			buffers.push_back(owner.buffer);
+		}
+		return owner.buffer;
+	}
+	//потоки пулу виконавців створюються заново для кожної задачі, тож без цього їхні буфери накопичувались би до кінця програми
+	static void releaseBuffersOfFinishedThreads() {
+		auto finished = std::stable_partition(buffers.begin(), buffers.end(), [](ThreadBuffer* buffer) { return !buffer->isThreadFinished; });
+		for (auto buffer = finished; buffer != buffers.end(); buffer++)
+			delete *buffer;
+		buffers.erase(finished, buffers.end());
+	}
+	//мікросекунди з трьома знаками після крапки, як очікує формат
+	static void appendMicroseconds(std::string& output, uint64_t nanoseconds) {
+		char fraction[8];
+		snprintf(fraction, sizeof(fraction), ".%03u", (unsigned)(nanoseconds % 1000));
+		output += std::to_string(nanoseconds / 1000);
+		output += fraction;
+	}
+
+public:
+	static void enable() {
+		origin = std::chrono::steady_clock::now();
+		isEnabled.store(true, std::memory_order_release);
+	}
+	static bool getIsEnabled() { return isEnabled.load(std::memory_order_relaxed); }
+	static uint64_t now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+	}
+
+	static void record(const char* name, uint64_t start, uint64_t end) {
+		ThreadBuffer* buffer = bufferOfThisThread();
+		Segment* segment = buffer->last;
+		size_t count = segment->count.load(std::memory_order_relaxed);
+		if (count == COUNT_OF_EVENTS_IN_SEGMENT) {
+			if (buffer->countOfSegments == MAX_COUNT_OF_SEGMENTS) {
+				buffer->countOfDropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			Segment* nextSegment = new Segment();
+			segment->next.store(nextSegment, std::memory_order_release);
+			buffer->last = segment = nextSegment;
+			buffer->countOfSegments++;
+			count = 0;
+		}
+		segment->events[count] = { name, start, end };
+		segment->count.store(count + 1, std::memory_order_release);
+	}
+	static void setThreadName(const char* name) {
+		if (getIsEnabled())
+			bufferOfThisThread()->name.store(name, std::memory_order_release);
+	}
+
+	//записує всі вже опубліковані події; потоки, що ще працюють, можуть писати далі.
+	//Після успішного запису буфери завершених потоків звільняються
+	static bool writeTo(const std::string& filepath) {
+		std::ofstream file(filepath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			return false;
+
+		std::lock_guard<std::mutex> guard(lockOfBuffers);
+		std::string output = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		bool isFirst = true;
+		for (ThreadBuffer* buffer : buffers) {
+			const char* name = buffer->name.load(std::memory_order_acquire);
+			output += std::string(isFirst ? "" : ",\n") + "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(buffer->id) +
+				",\"args\":{\"name\":\"" + (name ? name : "thread") + " " + std::to_string(buffer->id) + "\"}}";
+			isFirst = false;
+			if (size_t countOfDropped = buffer->countOfDropped.load(std::memory_order_relaxed))
+				output += ",\n{\"name\":\"dropped_events\",\"ph\":\"C\",\"pid\":1,\"tid\":" + std::to_string(buffer->id) + ",\"ts\":0,\"args\":{\"count\":" +
+					std::to_string(countOfDropped) + "}}";
+
+			for (Segment* segment = buffer->first; segment; segment = segment->next.load(std::memory_order_acquire)) {
+				size_t count = segment->count.load(std::memory_order_acquire);
+				for (size_t i = 0; i < count; i++) {
+					const Event& event = segment->events[i];
+					output += ",\n{\"name\":\"";
+					output += event.name;
+					output += "\",\"ph\":\"X\",\"pid\":1,\"tid\":" + std::to_string(buffer->id) + ",\"ts\":";
+					appendMicroseconds(output, event.start);
+					output += ",\"dur\":";
+					appendMicroseconds(output, event.end - event.start);
+					output += "}";
+				}
+				file.write(output.data(), output.size());
+				output.clear();
+			}
+		}
+		output += "\n]}\n";
+		file.write(output.data(), output.size());
+		file.close();
+		if (file.fail())
+			return false;
+
+		releaseBuffersOfFinishedThreads();
+		return true;
+	}
+};
+
+std::atomic<bool> Tracer::isEnabled(false);
+std::chrono::steady_clock::time_point Tracer::origin;
+std::mutex Tracer::lockOfBuffers;
+std::vector<Tracer::ThreadBuffer*> Tracer::buffers;
+unsigned Tracer::lastIdOfThread = 0;
+
+//подія трасування від створення до виходу з області видимості; name - рядковий літерал
+class TraceScope {
+private:
+	const char* name; //nullptr, якщо трасування вимкнене
+	uint64_t start;
+
+public:
+	TraceScope(const char* name) : name(Tracer::getIsEnabled() ? name : nullptr), start(this->name ? Tracer::now() : 0) {}
+	~TraceScope() {
+		if (name)
+			Tracer::record(name, start, Tracer::now());
+	}
+};
+
+class MappedFile {
+private:
+	HANDLE file, mapping;
+	const char* view; //відображення файлу в пам'ять лише для читання
+	size_t length;
+	std::string filepath;
+	bool shouldDeleteOnClose; //файл перенесено в тимчасове місце, і після закриття він більше не потрібен
+	mutable std::mutex lockOfFilepath; //файл переносить потік автозбереження, поки шлях може читати інший потік
+
+public:
+	MappedFile() : file(INVALID_HANDLE_VALUE), mapping(nullptr), view(nullptr), length(0), shouldDeleteOnClose(false) {}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile() { close(); }
+
+	bool open(std::string filepath) {
+		close();
+
+		file = CreateFileW(std::filesystem::path(filepath).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		{
+			std::lock_guard<std::mutex> guard(lockOfFilepath);
+			this->filepath = filepath;
+		}
+
+		LARGE_INTEGER sizeOfFile;
+		if (!GetFileSizeEx(file, &sizeOfFile)) {
+			close();
+			return false;
+		}
+
+		length = (size_t)sizeOfFile.QuadPart;
+		if (length == 0) //порожній файл відобразити неможливо, але й читати в ньому нічого
+			return true;
+
+		mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		view = mapping ? (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		if (!view) {
+			close();
+			return false;
+		}
+		return true;
+	}
+	void close() {
+		if (view)
+			UnmapViewOfFile(view);
+		if (mapping)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		{
+			std::lock_guard<std::mutex> guard(lockOfFilepath);
+			if (shouldDeleteOnClose)
+				remove(filepath.c_str());
+			shouldDeleteOnClose = false;
+		}
+
+		file = INVALID_HANDLE_VALUE;
+		mapping = nullptr;
+		view = nullptr;
+		length = 0;
+	}
+	//Windows не дає замінити або видалити відображений файл, але дозволяє перейменувати його, бо він відкритий з FILE_SHARE_DELETE;
+	//відображення при цьому залишається дійсним. Перейменування і зміна шляху йдуть під одним блокуванням
+	bool moveTo(std::string newFilepath, bool shouldDeleteOnClose) {
+		std::lock_guard<std::mutex> guard(lockOfFilepath);
+		if (!MoveFileExW(std::filesystem::path(filepath).c_str(), std::filesystem::path(newFilepath).c_str(), MOVEFILE_WRITE_THROUGH))
+			return false;
+
+		filepath = newFilepath;
+		this->shouldDeleteOnClose = shouldDeleteOnClose;
+		return true;
+	}
+
+	std::string getFilepath() const {
+		std::lock_guard<std::mutex> guard(lockOfFilepath);
+		return filepath;
+	}
+
+	const char* data() const { return view; }
+	size_t size() const { return length; }
+};
+
+class LineReader {
+private:
+	const char* data;
+	size_t length, offset; //розмір тексту та позиція початку наступного рядка
+
+public:
+	LineReader(const char* data, size_t length) : data(data), length(length), offset(0) {}
+
+	//повертає наступний рядок без символів кінця рядка, як це робить getline у текстовому режимі
+	bool nextLine(std::string_view& line) {
+		if (offset >= length)
+			return false;
+
+		size_t end = offset + ByteScanner::find(data + offset, length - offset, '\n');
+		size_t endOfLine = end > offset && data[end - 1] == '\r' ? end - 1 : end;
+
+		line = std::string_view(data + offset, endOfLine - offset);
+		offset = end + 1;
+		return true;
+	}
+};
+
+class TextBuffer {
+private:
+	struct Piece {
+		bool isInAddBuffer; //чи посилається шматок на буфер доданого тексту (інакше - на оригінальний текст файлу)
+		size_t start, length; //зміщення шматка в буфері та його довжина
+	};
+	struct Node {
+		Piece piece; //шматок тексту, який зберігає вузол
+		unsigned priority; //пріоритет вузла декартового дерева, підтримує дерево збалансованим
+		size_t subtreeLength; //сумарна довжина тексту в піддереві
+		size_t newlinesInPiece, subtreeNewlines; //кількість символів нового рядка в шматку та в усьому піддереві
+		size_t codepointsInPiece, subtreeCodepoints; //кількість символів UTF-8 (байтів, що починають символ) у шматку та в піддереві
+		Node* left, * right;
+
+		Node(Piece piece, unsigned priority, size_t newlinesInPiece, size_t codepointsInPiece) : piece(piece), priority(priority), subtreeLength(piece.length),
+			newlinesInPiece(newlinesInPiece), subtreeNewlines(newlinesInPiece), codepointsInPiece(codepointsInPiece), subtreeCodepoints(codepointsInPiece),
+			left(nullptr), right(nullptr) {}
+	};
+
+	static constexpr size_t SIZE_OF_NEWLINE_BLOCK = 64 * 1024, SIZE_OF_CODEPOINT_BLOCK = 4096;
+
+	std::shared_ptr<const std::string> originalBuffer; //незмінний текст, з яким буфер був створений
+	std::shared_ptr<MappedFile> originalFile; //у режимі великих файлів незмінний текст не копіюється, а читається з відображеного файлу
+	std::shared_ptr<std::string> addBuffer; //буфер, в кінець якого лише дописується вставлений текст, тому зміщення шматків у ньому не змінюються
+	std::shared_ptr<std::mutex> addBufferLock; //дописування може перемістити буфер вставок, поки копію тексту читає інший потік
+	//зміщення символів нового рядка в кожному з буферів; оскільки буфери лише доповнюються, ці масиви завжди відсортовані,
+	//і кількість рядків у будь-якому шматку рахується двійковим пошуком. Для відображеного файлу зберігається лише кількість
+	//символів нового рядка до початку кожного блоку, щоб пам'ять не залежала від кількості рядків файлу, а решта дораховується в блоці
+	std::shared_ptr<const std::vector<size_t>> originalNewlines;
+	std::shared_ptr<std::vector<size_t>> addNewlines;
+	//розріджений індекс символів: скільки символів UTF-8 у буфері до початку кожного блоку з SIZE_OF_CODEPOINT_BLOCK байтів,
+	//тож символи будь-якого шматка рахуються за двома вибірками і дочитуванням щонайбільше двох блоків. Будується лише при першому
+	//зверненні до символів (до того обидва вказівники порожні, а кількості символів у вузлах нульові), тож відкриття файлу його не чекає.
+	//Для тексту не в UTF-8 символ - це байт, тому індекс не будується і не підтримується зовсім
+	mutable std::shared_ptr<const std::vector<size_t>> originalCodepoints;
+	mutable std::shared_ptr<std::vector<size_t>> addCodepoints;
+	TextEncoding encoding, encodingOfFile; //кодування байтів у буфері і кодування, в якому текст записується у файл
+	Node* root; //корінь декартового дерева шматків, впорядкованих за позицією в тексті
+	unsigned seed; //стан генератора пріоритетів
+
+	unsigned nextPriority() {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		return seed;
+	}
+	static size_t lengthOf(Node* node) { return node ? node->subtreeLength : 0; }
+	static size_t newlinesOf(Node* node) { return node ? node->subtreeNewlines : 0; }
+	static size_t codepointsOf(Node* node) { return node ? node->subtreeCodepoints : 0; }
+	static void update(Node* node) {
+		node->subtreeLength = lengthOf(node->left) + node->piece.length + lengthOf(node->right);
+		node->subtreeNewlines = newlinesOf(node->left) + node->newlinesInPiece + newlinesOf(node->right);
+		node->subtreeCodepoints = codepointsOf(node->left) + node->codepointsInPiece + codepointsOf(node->right);
+	}
+	const char* dataOfOriginal() const { return originalFile ? originalFile->data() : originalBuffer->data(); }
+	const char* dataOf(const Piece& piece) const {
+		return (piece.isInAddBuffer ? addBuffer->data() : dataOfOriginal()) + piece.start;
+	}
+	//скільки символів нового рядка в буфері шматка передує зміщенню offset
+	size_t countNewlinesBefore(bool isInAddBuffer, size_t offset) const {
+		const std::vector<size_t>& newlines = isInAddBuffer ? *addNewlines : *originalNewlines;
+		if (isInAddBuffer || !originalFile)
+			return std::lower_bound(newlines.begin(), newlines.end(), offset) - newlines.begin();
+
+		size_t block = offset / SIZE_OF_NEWLINE_BLOCK, startOfBlock = block * SIZE_OF_NEWLINE_BLOCK;
+		return newlines[block] + ByteScanner::count(originalFile->data() + startOfBlock, offset - startOfBlock, '\n');
+	}
+	//зміщення символу нового рядка з даним номером у буфері
+	size_t positionOfNewline(bool isInAddBuffer, size_t index) const {
+		const std::vector<size_t>& newlines = isInAddBuffer ? *addNewlines : *originalNewlines;
+		if (isInAddBuffer || !originalFile)
+			return newlines[index];
+
+		size_t block = std::upper_bound(newlines.begin(), newlines.end(), index) - newlines.begin() - 1;
+		size_t position = block * SIZE_OF_NEWLINE_BLOCK;
+		for (size_t remaining = index - newlines[block];; remaining--) {
+			position += ByteScanner::find(originalFile->data() + position, originalFile->size() - position, '\n');
+			if (remaining == 0)
+				return position;
+			position++;
+		}
+	}
+	//скільки символів UTF-8 у буфері починається до зміщення offset
+	size_t countCodepointsBefore(bool isInAddBuffer, size_t offset) const {
+		const std::vector<size_t>& codepoints = isInAddBuffer ? *addCodepoints : *originalCodepoints;
+		size_t block = offset / SIZE_OF_CODEPOINT_BLOCK, startOfBlock = block * SIZE_OF_CODEPOINT_BLOCK;
+		return codepoints[block] + Utf8::countCodepoints((isInAddBuffer ? addBuffer->data() : dataOfOriginal()) + startOfBlock, offset - startOfBlock);
+	}
+	//зміщення в буфері байта, з якого починається символ з даним номером
+	size_t positionOfCodepoint(bool isInAddBuffer, size_t index) const {
+		const std::vector<size_t>& codepoints = isInAddBuffer ? *addCodepoints : *originalCodepoints;
+		const char* data = isInAddBuffer ? addBuffer->data() : dataOfOriginal();
+		size_t block = std::upper_bound(codepoints.begin(), codepoints.end(), index) - codepoints.begin() - 1;
+		size_t position = block * SIZE_OF_CODEPOINT_BLOCK;
+		for (size_t remaining = index - codepoints[block];; position++)
+			if (!Utf8::isContinuation(data[position]) && remaining-- == 0)
+				return position;
+	}
+	static std::shared_ptr<std::vector<size_t>> sampleCodepoints(const char* data, size_t length) {
+		std::shared_ptr<std::vector<size_t>> codepoints = std::make_shared<std::vector<size_t>>(1, 0);
+		for (size_t start = 0; start + SIZE_OF_CODEPOINT_BLOCK <= length; start += SIZE_OF_CODEPOINT_BLOCK)
+			codepoints->push_back(codepoints->back() + Utf8::countCodepoints(data + start, SIZE_OF_CODEPOINT_BLOCK));
+		return codepoints;
+	}
+	//номер першого символу нового рядка шматка серед символів нового рядка його буфера
+	size_t firstNewlineIndexOf(const Piece& piece, size_t offsetInPiece = 0) const {
+		return countNewlinesBefore(piece.isInAddBuffer, piece.start + offsetInPiece);
+	}
+	size_t countNewlinesIn(const Piece& piece) const { return firstNewlineIndexOf(piece, piece.length) - firstNewlineIndexOf(piece); }
+	size_t countCodepointsIn(const Piece& piece) const {
+		return countCodepointsBefore(piece.isInAddBuffer, piece.start + piece.length) - countCodepointsBefore(piece.isInAddBuffer, piece.start);
+	}
+	Node* createNode(Piece piece) { return new Node(piece, nextPriority(), countNewlinesIn(piece), addCodepoints ? countCodepointsIn(piece) : 0); }
+	void countCodepointsOfNodes(Node* node) const {
+		if (!node)
+			return;
+		countCodepointsOfNodes(node->left);
+		countCodepointsOfNodes(node->right);
+		node->codepointsInPiece = countCodepointsIn(node->piece);
+		update(node);
+	}
+	//індекс будується за один прохід буферів, а кількості символів у вузлах дерева дораховуються з нього
+	void ensureCodepointIndex() const {
+		if (addCodepoints)
+			return;
+		originalCodepoints = sampleCodepoints(dataOfOriginal(), originalFile ? originalFile->size() : originalBuffer->size());
+		addCodepoints = sampleCodepoints(addBuffer->data(), addBuffer->size());
+		countCodepointsOfNodes(root);
+	}
+	static void appendNewlinePositions(std::vector<size_t>& newlines, const char* data, size_t length, size_t offsetOfData) {
+		for (size_t i = ByteScanner::find(data, length, '\n'); i < length; i = i + 1 + ByteScanner::find(data + i + 1, length - i - 1, '\n'))
+			newlines.push_back(offsetOfData + i);
+	}
+
+	static Node* clone(Node* node) {
+		if (!node)
+			return nullptr;
+		Node* copy = new Node(*node);
+		copy->left = clone(node->left);
+		copy->right = clone(node->right);
+		return copy;
+	}
+	static void destroy(Node* node) {
+		if (!node)
+			return;
+		destroy(node->left);
+		destroy(node->right);
+		delete node;
+	}
+
+	Node* merge(Node* left, Node* right) {
+		if (!left || !right)
+			return left ? left : right;
+
+		if (left->priority > right->priority) {
+			left->right = merge(left->right, right);
+			update(left);
+			return left;
+		}
+		right->left = merge(left, right->left);
+		update(right);
+		return right;
+	}
+	//розділяє дерево так, щоб у лівій частині опинились перші position символів; шматок, який перетинає межу, розрізається на два
+	void split(Node* node, size_t position, Node*& left, Node*& right) {
+		if (!node) {
+			left = right = nullptr;
+			return;
+		}
+
+		size_t leftLength = lengthOf(node->left);
+
+		if (position <= leftLength) {
+			split(node->left, position, left, node->left);
+			update(node);
+			right = node;
+		}
+		else if (position >= leftLength + node->piece.length) {
+			split(node->right, position - leftLength - node->piece.length, node->right, right);
+			update(node);
+			left = node;
+		}
+		else {
+			size_t offsetInPiece = position - leftLength;
+			Node* tail = createNode({ node->piece.isInAddBuffer, node->piece.start + offsetInPiece, node->piece.length - offsetInPiece });
+			Node* rightSubtree = node->right;
+
+			node->piece.length = offsetInPiece;
+			node->newlinesInPiece -= tail->newlinesInPiece;
+			node->codepointsInPiece -= tail->codepointsInPiece;
+			node->right = nullptr;
+			update(node);
+
+			left = node;
+			right = merge(tail, rightSubtree);
+		}
+	}
+	//дописує text до останнього шматка дерева, якщо той закінчується там, де в буфері доданого тексту починається text (послідовний набір тексту)
+	bool tryToExtendLastPiece(Node* node, size_t startOfText, size_t lengthOfText, size_t newlinesInText, size_t codepointsInText) {
+		Node* last = node;
+		while (last && last->right)
+			last = last->right;
+
+		if (!last || !last->piece.isInAddBuffer || last->piece.start + last->piece.length != startOfText)
+			return false;
+
+		last->piece.length += lengthOfText;
+		last->newlinesInPiece += newlinesInText;
+		last->codepointsInPiece += codepointsInText;
+		for (; node; node = node->right) {
+			node->subtreeLength += lengthOfText;
+			node->subtreeNewlines += newlinesInText;
+			node->subtreeCodepoints += codepointsInText;
+		}
+		return true;
+	}
+	bool visitPieces(Node* node, size_t nodeStart, size_t from, size_t to, const std::function<bool(const char*, size_t)>& action) const {
+		if (!node || to <= nodeStart || from >= nodeStart + node->subtreeLength)
+			return true;
+
+		if (!visitPieces(node->left, nodeStart, from, to, action))
+			return false;
+
+		size_t pieceStart = nodeStart + lengthOf(node->left), pieceEnd = pieceStart + node->piece.length;
+		if (from < pieceEnd && to > pieceStart) {
+			size_t begin = std::max(from, pieceStart), end = std::min(to, pieceEnd);
+			if (!action(dataOf(node->piece) + (begin - pieceStart), end - begin))
+				return false;
+		}
+
+		return visitPieces(node->right, pieceEnd, from, to, action);
+	}
+	void collectPieces(Node* node, size_t nodeStart, size_t from, size_t to, std::vector<Piece>& pieces) const {
+		if (!node || to <= nodeStart || from >= nodeStart + node->subtreeLength)
+			return;
+
+		collectPieces(node->left, nodeStart, from, to, pieces);
+
+		size_t pieceStart = nodeStart + lengthOf(node->left), pieceEnd = pieceStart + node->piece.length;
+		if (from < pieceEnd && to > pieceStart) {
+			size_t begin = std::max(from, pieceStart), end = std::min(to, pieceEnd);
+			pieces.push_back({ node->piece.isInAddBuffer, node->piece.start + (begin - pieceStart), end - begin });
+		}
+
+		collectPieces(node->right, pieceEnd, from, to, pieces);
+	}
+
+public:
+	static const size_t npos = std::string::npos;
+
+	TextBuffer() : TextBuffer(std::string()) {}
+	TextBuffer(std::string text) {
+		std::shared_ptr<std::vector<size_t>> newlines = std::make_shared<std::vector<size_t>>();
+		appendNewlinePositions(*newlines, text.data(), text.size(), 0);
+
+		originalBuffer = std::make_shared<const std::string>(std::move(text));
+		originalNewlines = newlines;
+		addBuffer = std::make_shared<std::string>();
+		addBufferLock = std::make_shared<std::mutex>();
+		addNewlines = std::make_shared<std::vector<size_t>>();
+		encoding = encodingOfFile = TextEncoding::Cp1251;
+		seed = 2463534242u;
+		root = originalBuffer->empty() ? nullptr : createNode({ false, 0, originalBuffer->size() });
+	}
+	//режим великих файлів: файл не читається в пам'ять, а лише один раз переглядається, щоб порахувати символи нового рядка по блоках;
+	//в пам'яті залишаються тільки вставлений текст і дерево шматків
+	TextBuffer(std::shared_ptr<MappedFile> file) : TextBuffer() {
+		std::shared_ptr<std::vector<size_t>> newlinesBeforeBlocks = std::make_shared<std::vector<size_t>>(1, 0);
+		for (size_t start = 0; start < file->size(); start += SIZE_OF_NEWLINE_BLOCK) {
+			size_t length = std::min(file->size() - start, SIZE_OF_NEWLINE_BLOCK);
+			newlinesBeforeBlocks->push_back(newlinesBeforeBlocks->back() + ByteScanner::count(file->data() + start, length, '\n'));
+		}
+
+		originalFile = file;
+		originalNewlines = newlinesBeforeBlocks;
+		root = file->size() == 0 ? nullptr : createNode({ false, 0, file->size() });
+	}
+	//копія ділить з оригіналом буфери тексту і дублює лише дерево шматків
+	TextBuffer(const TextBuffer& other) : originalBuffer(other.originalBuffer), originalFile(other.originalFile), addBuffer(other.addBuffer),
+		addBufferLock(other.addBufferLock), originalNewlines(other.originalNewlines), addNewlines(other.addNewlines), originalCodepoints(other.originalCodepoints),
+		addCodepoints(other.addCodepoints), encoding(other.encoding), encodingOfFile(other.encodingOfFile), root(clone(other.root)), seed(other.seed) {}
+	TextBuffer& operator=(const TextBuffer& other) {
+		if (this != &other) {
+			destroy(root);
+			originalBuffer = other.originalBuffer;
+			originalFile = other.originalFile;
+			addBuffer = other.addBuffer;
+			addBufferLock = other.addBufferLock;
+			originalNewlines = other.originalNewlines;
+			addNewlines = other.addNewlines;
+			originalCodepoints = other.originalCodepoints;
+			addCodepoints = other.addCodepoints;
+			encoding = other.encoding;
+			encodingOfFile = other.encodingOfFile;
+			root = clone(other.root);
+			seed = other.seed;
+		}
+		return *this;
+	}
+	~TextBuffer() { destroy(root); }
+
+	//фрагмент [position, position + count), що ділить з цим буфером байти тексту: створюються лише вузли шматків діапазону
+	TextBuffer slice(size_t position, size_t count) const {
+		std::vector<Piece> pieces;
+		size_t to = count > size() - std::min(position, size()) ? size() : position + count;
+		collectPieces(root, 0, position, to, pieces);
+
+		TextBuffer result;
+		result.originalBuffer = originalBuffer;
+		result.originalFile = originalFile;
+		result.addBuffer = addBuffer;
+		result.addBufferLock = addBufferLock;
+		result.originalNewlines = originalNewlines;
+		result.addNewlines = addNewlines;
+		result.originalCodepoints = originalCodepoints;
+		result.addCodepoints = addCodepoints;
+		result.encoding = encoding;
+		result.encodingOfFile = encodingOfFile;
+		for (const Piece& piece : pieces)
+			result.root = result.merge(result.root, result.createNode(piece));
+		return result;
+	}
+
+	size_t size() const { return lengthOf(root); }
+	bool empty() const { return size() == 0; }
+	//скільки байтів пам'яті займають буфери тексту; відображений файл не враховується, бо його сторінки читаються з диска
+	size_t sizeInMemory() const {
+		return (originalFile ? 0 : originalBuffer->size()) + addBuffer->size() +
+			(originalNewlines->size() + addNewlines->size() + (addCodepoints ? originalCodepoints->size() + addCodepoints->size() : 0)) * sizeof(size_t);
+	}
+	TextEncoding getEncoding() const { return encoding; }
+	TextEncoding getEncodingOfFile() const { return encodingOfFile; }
+	void setEncoding(TextEncoding encoding, TextEncoding encodingOfFile) {
+		this->encoding = encoding;
+		this->encodingOfFile = encodingOfFile;
+		if (encoding != TextEncoding::Utf8) {
+			originalCodepoints = nullptr;
+			addCodepoints = nullptr;
+		}
+	}
+	//відображений файл, на який посилається текст у режимі великих файлів, або nullptr
+	std::shared_ptr<MappedFile> getOriginalFile() const { return originalFile; }
+
+	char at(size_t position) const {
+		Node* node = root;
+		while (node) {
+			size_t leftLength = lengthOf(node->left);
+			if (position < leftLength)
+				node = node->left;
+			else if (position < leftLength + node->piece.length)
+				return dataOf(node->piece)[position - leftLength];
+			else {
+				position -= leftLength + node->piece.length;
+				node = node->right;
+			}
+		}
+		return '\0';
+	}
+
+	void insert(size_t position, std::string_view text) {
+		if (text.empty())
+			return;
+
+		Node* left, * right;
+		split(root, std::min(position, size()), left, right);
+
+		size_t startOfText = addBuffer->size(), countOfNewlinesBefore = addNewlines->size();
+		appendNewlinePositions(*addNewlines, text.data(), text.size(), startOfText);
+		{
+			std::lock_guard<std::mutex> guard(*addBufferLock);
+			addBuffer->append(text);
+		}
+		if (addCodepoints)
+			for (size_t block = addCodepoints->size(); block * SIZE_OF_CODEPOINT_BLOCK <= addBuffer->size(); block++)
+				addCodepoints->push_back(addCodepoints->back() + Utf8::countCodepoints(addBuffer->data() + (block - 1) * SIZE_OF_CODEPOINT_BLOCK, SIZE_OF_CODEPOINT_BLOCK));
+
+		size_t codepointsInText = addCodepoints ? Utf8::countCodepoints(text.data(), text.size()) : 0;
+		if (!tryToExtendLastPiece(left, startOfText, text.size(), addNewlines->size() - countOfNewlinesBefore, codepointsInText))
+			left = merge(left, createNode({ true, startOfText, text.size() }));
+		root = merge(left, right);
+	}
+	void erase(size_t position, size_t count = npos) {
+		if (position >= size())
+			return;
+
+		Node* left, * middle, * right;
+		split(root, position, left, middle);
+		split(middle, std::min(count, lengthOf(middle)), middle, right);
+		destroy(middle);
+		root = merge(left, right);
+	}
+	void replace(size_t position, size_t count, std::string_view text) {
+		erase(position, count);
+		insert(position, text);
+	}
+
+	//рядки нумеруються з 0; обидва перетворення - спуск по дереву за лічильниками піддерев і двійковий пошук у шматку, O(log n)
+	size_t countOfLines() const { return newlinesOf(root) + 1; }
+	//зміщення першого символу рядка або npos, якщо такого рядка немає
+	size_t offsetOfLine(size_t line) const {
+		if (line == 0)
+			return 0;
+		if (line > newlinesOf(root))
+			return npos;
+
+		Node* node = root;
+		size_t offset = 0;
+		while (node) {
+			size_t newlinesInLeft = newlinesOf(node->left);
+			if (line <= newlinesInLeft)
+				node = node->left;
+			else if (line <= newlinesInLeft + node->newlinesInPiece) {
+				size_t positionInBuffer = positionOfNewline(node->piece.isInAddBuffer, firstNewlineIndexOf(node->piece) + line - newlinesInLeft - 1);
+				return offset + lengthOf(node->left) + positionInBuffer - node->piece.start + 1;
+			}
+			else {
+				line -= newlinesInLeft + node->newlinesInPiece;
+				offset += lengthOf(node->left) + node->piece.length;
+				node = node->right;
+			}
+		}
+		return npos;
+	}
+	//номер рядка, в якому стоїть символ з даним зміщенням (для зміщення size() - останній рядок)
+	size_t lineOfOffset(size_t position) const {
+		Node* node = root;
+		size_t line = 0;
+		while (node) {
+			size_t leftLength = lengthOf(node->left);
+			if (position < leftLength)
+				node = node->left;
+			else if (position < leftLength + node->piece.length)
+				return line + newlinesOf(node->left) + firstNewlineIndexOf(node->piece, position - leftLength) - firstNewlineIndexOf(node->piece);
+			else {
+				line += newlinesOf(node->left) + node->newlinesInPiece;
+				position -= leftLength + node->piece.length;
+				node = node->right;
+			}
+		}
+		return line;
+	}
+	//довжина рядка без символу нового рядка
+	size_t lengthOfLine(size_t line) const {
+		size_t start = offsetOfLine(line);
+		if (start == npos)
+			return 0;
+		size_t next = offsetOfLine(line + 1);
+		return (next == npos ? size() + 1 : next) - start - 1;
+	}
+
+	//символи UTF-8 нумеруються з 0; як і для рядків, перетворення - спуск по дереву і дочитування блоку розрідженого індексу, O(log n)
+	size_t countOfCodepoints() const {
+		if (encoding != TextEncoding::Utf8)
+			return size();
+		ensureCodepointIndex();
+		return codepointsOf(root);
+	}
+	//скільки символів починається до зміщення position
+	size_t codepointOfOffset(size_t position) const {
+		if (encoding != TextEncoding::Utf8)
+			return std::min(position, size());
+		ensureCodepointIndex();
+		Node* node = root;
+		size_t codepoint = 0;
+		while (node) {
+			size_t leftLength = lengthOf(node->left);
+			if (position < leftLength)
+				node = node->left;
+			else if (position < leftLength + node->piece.length)
+				return codepoint + codepointsOf(node->left) + countCodepointsBefore(node->piece.isInAddBuffer, node->piece.start + position - leftLength) -
+					countCodepointsBefore(node->piece.isInAddBuffer, node->piece.start);
+			else {
+				codepoint += codepointsOf(node->left) + node->codepointsInPiece;
+				position -= leftLength + node->piece.length;
+				node = node->right;
+			}
+		}
+		return codepoint;
+	}
+	//зміщення першого байта символу з даним номером; для номера countOfCodepoints() - size()
+	size_t offsetOfCodepoint(size_t index) const {
+		if (encoding != TextEncoding::Utf8)
+			return std::min(index, size());
+		ensureCodepointIndex();
+		Node* node = root;
+		size_t offset = 0;
+		while (node) {
+			size_t codepointsInLeft = codepointsOf(node->left);
+			if (index < codepointsInLeft)
+				node = node->left;
+			else if (index < codepointsInLeft + node->codepointsInPiece) {
+				size_t positionInBuffer = positionOfCodepoint(node->piece.isInAddBuffer,
+					countCodepointsBefore(node->piece.isInAddBuffer, node->piece.start) + index - codepointsInLeft);
+				return offset + lengthOf(node->left) + positionInBuffer - node->piece.start;
+			}
+			else {
+				index -= codepointsInLeft + node->codepointsInPiece;
+				offset += lengthOf(node->left) + node->piece.length;
+				node = node->right;
+			}
+		}
+		return size();
+	}
+
+	//викликає action для кожного неперервного фрагмента тексту в діапазоні [position, position + count), поки action повертає true
+	void forEachPiece(size_t position, size_t count, const std::function<bool(const char*, size_t)>& action) const {
+		size_t to = count > size() - std::min(position, size()) ? size() : position + count;
+		visitPieces(root, 0, position, to, action);
+	}
+	void forEachPiece(const std::function<bool(const char*, size_t)>& action) const { forEachPiece(0, npos, action); }
+
+	std::string substr(size_t position, size_t count = npos) const {
+		std::string result;
+		forEachPiece(position, count, [&result](const char* data, size_t length) {
+			result.append(data, length);
+			return true;
+			});
+		return result;
+	}
+	std::string toString() const { return substr(0); }
+
+	//для копії, яку читає інший потік, поки в оригінал дописується текст: незмінний початковий текст читається напряму,
+	//а байти буфера вставок копіюються частинами під блокуванням, щоб дописування чекало щонайбільше одну частину
+	void forEachPieceOfSnapshot(const std::function<bool(const char*, size_t)>& action) const {
+		const size_t SIZE_OF_PART = 1024 * 1024;
+		std::vector<Piece> pieces;
+		std::string part;
+
+		collectPieces(root, 0, 0, size(), pieces);
+		for (const Piece& piece : pieces) {
+			if (!piece.isInAddBuffer) {
+				if (!action(dataOfOriginal() + piece.start, piece.length))
+					return;
+				continue;
+			}
+			for (size_t offset = 0; offset < piece.length; offset += SIZE_OF_PART) {
+				size_t length = std::min(SIZE_OF_PART, piece.length - offset);
+				{
+					std::lock_guard<std::mutex> guard(*addBufferLock);
+					part.assign(addBuffer->data() + piece.start + offset, length);
+				}
+				if (!action(part.data(), length))
+					return;
+			}
+		}
+	}
+
+	void writeTo(std::ostream& stream) const {
+		forEachPiece([&stream](const char* data, size_t length) {
+			stream.write(data, length);
+			return true;
+			});
+	}
+};
+
+class TextSearcher {
+private:
+	static const size_t MIN_LENGTH_FOR_SKIP_TABLE = 32; //з такої довжини зразка таблиця зсувів вигідніша за векторне порівняння
+
+#ifdef EDITOR_HAS_X86_SIMD
+	//порівнює перший і останній символи зразка одразу з 32 позиціями, а повністю перевіряє лише позиції, де збіглись обидва
+	EDITOR_TARGET_AVX2 static bool searchBlockAvx2(const char* data, size_t length, const std::string& pattern, size_t& position, const std::function<bool(size_t)>& onMatch) {
+		size_t lastIndex = pattern.size() - 1;
+		__m256i first = _mm256_set1_epi8(pattern[0]), last = _mm256_set1_epi8(pattern[lastIndex]);
+
+		for (; position + lastIndex + 32 <= length; position += 32) {
+			__m256i blockOfFirst = _mm256_loadu_si256((const __m256i*)(data + position));
+			__m256i blockOfLast = _mm256_loadu_si256((const __m256i*)(data + position + lastIndex));
+			unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, blockOfFirst), _mm256_cmpeq_epi8(last, blockOfLast)));
+
+			for (; mask; mask &= mask - 1) {
+				size_t candidate = position + ByteScanner::lowestSetBit(mask);
+				if (memcmp(data + candidate + 1, pattern.data() + 1, lastIndex - 1) == 0 && !onMatch(candidate))
+					return false;
+			}
+		}
+		return true;
+	}
+	static bool searchBlockSse2(const char* data, size_t length, const std::string& pattern, size_t& position, const std::function<bool(size_t)>& onMatch) {
+		size_t lastIndex = pattern.size() - 1;
+		__m128i first = _mm_set1_epi8(pattern[0]), last = _mm_set1_epi8(pattern[lastIndex]);
+
+		for (; position + lastIndex + 16 <= length; position += 16) {
+			__m128i blockOfFirst = _mm_loadu_si128((const __m128i*)(data + position));
+			__m128i blockOfLast = _mm_loadu_si128((const __m128i*)(data + position + lastIndex));
+			unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, blockOfFirst), _mm_cmpeq_epi8(last, blockOfLast)));
+
+			for (; mask; mask &= mask - 1) {
+				size_t candidate = position + ByteScanner::lowestSetBit(mask);
+				if (memcmp(data + candidate + 1, pattern.data() + 1, lastIndex - 1) == 0 && !onMatch(candidate))
+					return false;
+			}
+		}
+		return true;
+	}
+#endif
+	//алгоритм Хорспула: після невдалої перевірки зразок зсувається за символом тексту під останнім символом зразка
+	static bool searchBlockWithSkipTable(const char* data, size_t length, const std::string& pattern, const std::function<bool(size_t)>& onMatch) {
+		size_t shifts[256], lastIndex = pattern.size() - 1;
+
+		for (size_t& shift : shifts)
+			shift = pattern.size();
+		for (size_t i = 0; i < lastIndex; i++)
+			shifts[(unsigned char)pattern[i]] = lastIndex - i;
+
+		for (size_t position = 0; position + pattern.size() <= length;) {
+			unsigned char lastCharacter = data[position + lastIndex];
+			if (lastCharacter == (unsigned char)pattern[lastIndex] && memcmp(data + position, pattern.data(), lastIndex) == 0 && !onMatch(position))
+				return false;
+			position += shifts[lastCharacter];
+		}
+		return true;
+	}
+	//знаходить усі (в тому числі ті, що перекриваються) входження зразка в неперервному фрагменті тексту
+	static bool searchBlock(const char* data, size_t length, const std::string& pattern, const std::function<bool(size_t)>& onMatch) {
+		if (pattern.size() > length)
+			return true;
+
+		if (pattern.size() == 1) {
+			for (size_t position = ByteScanner::find(data, length, pattern[0]); position < length; position += 1 + ByteScanner::find(data + position + 1, length - position - 1, pattern[0]))
+				if (!onMatch(position))
+					return false;
+			return true;
+		}
+
+		if (pattern.size() >= MIN_LENGTH_FOR_SKIP_TABLE)
+			return searchBlockWithSkipTable(data, length, pattern, onMatch);
+
+		size_t position = 0;
+#ifdef EDITOR_HAS_X86_SIMD
+		if (!(ByteScanner::useAvx2() ? searchBlockAvx2(data, length, pattern, position, onMatch) : searchBlockSse2(data, length, pattern, position, onMatch)))
+			return false;
+#endif
+		for (; position + pattern.size() <= length; position++)
+			if (data[position] == pattern[0] && memcmp(data + position + 1, pattern.data() + 1, pattern.size() - 1) == 0 && !onMatch(position))
+				return false;
+		return true;
+	}
+
+public:
+	static const size_t npos = std::string::npos;
+
+	//за один прохід по шматках тексту викликає onMatch для кожного входження, яке не перекривається з попереднім,
+	//починаючи з позиції from, поки onMatch повертає true
+	static void forEachMatch(const TextBuffer* text, const std::string& pattern, size_t from, const std::function<bool(size_t)>& onMatch) {
+		if (pattern.empty())
+			return;
+
+		size_t offset = 0, carryStart = 0, nextAllowedPosition = from;
+		std::string carry; //останні pattern.size() - 1 символів попередніх шматків, щоб знаходити входження на межах шматків
+		bool shouldContinue = true;
+
+		auto report = [&](size_t position) {
+			if (position < nextAllowedPosition)
+				return true;
+			nextAllowedPosition = position + pattern.size();
+			shouldContinue = onMatch(position);
+			return shouldContinue;
+		};
+
+		text->forEachPiece([&](const char* data, size_t length) {
+			if (!carry.empty()) {
+				std::string joint = carry + std::string(data, std::min(length, pattern.size() - 1));
+				searchBlock(joint.data(), joint.size(), pattern, [&](size_t position) {
+					return position < carry.size() ? report(carryStart + position) : false;
+					});
+				if (!shouldContinue)
+					return false;
+			}
+
+			if (!searchBlock(data, length, pattern, [&](size_t position) { return report(offset + position); }))
+				return false;
+
+			carry.append(data + length - std::min(length, pattern.size() - 1), std::min(length, pattern.size() - 1));
+			offset += length;
+			if (carry.size() > pattern.size() - 1)
+				carry.erase(0, carry.size() - (pattern.size() - 1));
+			carryStart = offset - carry.size();
+			return true;
+			});
+	}
+	static std::vector<size_t> findAll(const TextBuffer* text, const std::string& pattern, size_t from = 0) {
+		std::vector<size_t> positions;
+		forEachMatch(text, pattern, from, [&positions](size_t position) {
+			positions.push_back(position);
+			return true;
+			});
+		return positions;
+	}
+	//number починається з 1; повертає npos, якщо входжень менше
+	static size_t findNth(const TextBuffer* text, const std::string& pattern, size_t number, size_t from = 0) {
+		size_t result = npos;
+		forEachMatch(text, pattern, from, [&result, &number](size_t position) {
+			if (--number > 0)
+				return true;
+			result = position;
+			return false;
+			});
+		return result;
+	}
+	static size_t find(const TextBuffer* text, const std::string& pattern, size_t from = 0) { return findNth(text, pattern, 1, from); }
+	//усі входження зразка, в тому числі ті, що перекриваються, в неперервному блоці пам'яті (наприклад, у відображеному файлі)
+	static bool forEachOccurrence(const char* data, size_t length, const std::string& pattern, const std::function<bool(size_t)>& onMatch) {
+		return pattern.empty() || searchBlock(data, length, pattern, onMatch);
+	}
+};
+
+class AhoCorasick {
+private:
+	std::vector<std::string> patterns;
+	unsigned char classOfByte[256]; //символи, яких немає в зразках, об'єднані в один клас, щоб таблиця переходів була компактною
+	int countOfClasses;
+	std::vector<int> transitions; //повна таблиця переходів автомата: transitions[стан * countOfClasses + клас символу]
+	std::vector<int> depth; //довжина префікса зразка, якому відповідає стан
+	std::vector<int> longestPattern; //найдовший зразок, яким закінчується префікс стану (з урахуванням суфіксних посилань), або -1
+	size_t maxLengthOfPattern;
+
+	int next(int state, unsigned char byte) const { return transitions[state * countOfClasses + classOfByte[byte]]; }
+	int addState(int depthOfState) {
+		transitions.resize(transitions.size() + countOfClasses, -1);
+		depth.push_back(depthOfState);
+		longestPattern.push_back(-1);
+		return depth.size() - 1;
+	}
+
+public:
+	struct Match {
+		size_t position;
+		int patternIndex;
+	};
+
+	AhoCorasick(const std::vector<std::string>& patterns) : patterns(patterns), maxLengthOfPattern(0) {
+		memset(classOfByte, 0, sizeof(classOfByte));
+		countOfClasses = 1;
+		for (const std::string& pattern : patterns)
+			for (unsigned char byte : pattern)
+				if (!classOfByte[byte])
+					classOfByte[byte] = countOfClasses++;
+
+		addState(0);
+		for (int i = 0; i < patterns.size(); i++) {
+			if (patterns[i].empty())
+				continue;
+
+			int state = 0;
+			for (unsigned char byte : patterns[i]) {
+				int& transition = transitions[state * countOfClasses + classOfByte[byte]];
+				if (transition == -1) {
+					int newState = addState(depth[state] + 1);
+					transitions[state * countOfClasses + classOfByte[byte]] = newState;
+				}
+				state = transitions[state * countOfClasses + classOfByte[byte]];
+			}
+			longestPattern[state] = i; //якщо зразок повторюється, діє останній
+			maxLengthOfPattern = std::max(maxLengthOfPattern, patterns[i].size());
+		}
+
+		//обхід у ширину: суфіксні посилання та добудова відсутніх переходів, щоб пошук робив рівно один перехід на символ
+		std::vector<int> failure(depth.size(), 0), queue;
+		for (int symbolClass = 0; symbolClass < countOfClasses; symbolClass++) {
+			int& transition = transitions[symbolClass];
+			if (transition == -1)
+				transition = 0;
+			else
+				queue.push_back(transition);
+		}
+		for (size_t head = 0; head < queue.size(); head++) {
+			int state = queue[head];
+			if (longestPattern[state] == -1)
+				longestPattern[state] = longestPattern[failure[state]];
+
+			for (int symbolClass = 0; symbolClass < countOfClasses; symbolClass++) {
+				int& transition = transitions[state * countOfClasses + symbolClass];
+				int fallback = transitions[failure[state] * countOfClasses + symbolClass];
+				if (transition == -1)
+					transition = fallback;
+				else {
+					failure[transition] = fallback;
+					queue.push_back(transition);
+				}
+			}
+		}
+	}
+
+	//за один прохід знаходить входження, що не перекриваються: з кількох кандидатів обирається той, що починається раніше,
+	//а з тих, що починаються в одній позиції, - найдовший
+	std::vector<Match> findLeftmostLongest(const TextBuffer* text) const {
+		std::vector<Match> matches;
+		std::string window; //останні прочитані символи, які можуть знадобитись для повторного проходу після прийнятого входження
+		size_t windowStart = 0;
+		int state = 0;
+		bool hasCandidate = false;
+		Match candidate = { 0, -1 };
+
+		std::function<void(unsigned char, size_t)> process;
+		auto acceptCandidate = [&](size_t lastPosition) {
+			matches.push_back(candidate);
+			hasCandidate = false;
+			state = 0;
+			for (size_t position = candidate.position + patterns[candidate.patternIndex].size(); position <= lastPosition; position++)
+				process(window[position - windowStart], position);
+		};
+		process = [&](unsigned char byte, size_t position) {
+			state = next(state, byte);
+
+			int patternIndex = longestPattern[state];
+			if (patternIndex != -1) {
+				size_t start = position + 1 - patterns[patternIndex].size();
+				if (!hasCandidate || start <= candidate.position) {
+					candidate = { start, patternIndex };
+					hasCandidate = true;
+				}
+			}
+
+			//жодне ще не завершене входження вже не може початись раніше або там само, де кандидат
+			if (hasCandidate && position + 1 - depth[state] > candidate.position)
+				acceptCandidate(position);
+		};
+
+		size_t position = 0;
+		text->forEachPiece([&](const char* data, size_t length) {
+			for (size_t i = 0; i < length; i++, position++) {
+				window += data[i];
+				if (window.size() > 2 * (maxLengthOfPattern + 1)) {
+					size_t countToDrop = window.size() - (maxLengthOfPattern + 1);
+					window.erase(0, countToDrop);
+					windowStart += countToDrop;
+				}
+				process(data[i], position);
+			}
+			return true;
+			});
+
+		while (hasCandidate)
+			acceptCandidate(position - 1);
+
+		return matches;
+	}
+};
+
+struct TextDelta {
+	size_t position = 0; //позиція в тексті, з якої почалась зміна
+	std::string removedText, insertedText; //текст, який був видалений, і текст, який був вставлений на його місце
+
+	void applyTo(TextBuffer* text) const { text->replace(position, removedText.size(), insertedText); }
+	void revertOn(TextBuffer* text) const { text->replace(position, insertedText.size(), removedText); }
+};
+
+class BinaryFormat {
+public:
+	//previous - контрольна сума попередніх фрагментів, щоб рахувати її для тексту, що лежить частинами
+	static uint32_t crc32(const char* data, size_t length, uint32_t previous = 0) {
+		//статична змінна ініціалізується рівно один раз навіть тоді, коли перші виклики йдуть з кількох потоків одночасно
+		static const std::array<uint32_t, 256> table = []() {
+			std::array<uint32_t, 256> result;
+			for (uint32_t i = 0; i < 256; i++) {
+				uint32_t value = i;
+				for (int bit = 0; bit < 8; bit++)
+					value = value & 1 ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+				result[i] = value;
+			}
+			return result;
+		}();
+
+		uint32_t crc = previous ^ 0xFFFFFFFFu;
+		for (size_t i = 0; i < length; i++)
+			crc = table[(crc ^ (unsigned char)data[i]) & 0xFF] ^ (crc >> 8);
+		return crc ^ 0xFFFFFFFFu;
+	}
+	static void appendVarint(std::string& out, uint64_t value) {
+		while (value >= 0x80) {
+			out += (char)((value & 0x7F) | 0x80);
+			value >>= 7;
+		}
+		out += (char)value;
+	}
+	static bool readVarint(std::string_view in, size_t& offset, uint64_t& value) {
+		value = 0;
+		for (int shift = 0; offset < in.size() && shift < 64; shift += 7) {
+			unsigned char byte = in[offset++];
+			value |= (uint64_t)(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+				return true;
+		}
+		return false;
+	}
+	static bool readBytes(std::string_view in, size_t& offset, std::string& out) {
+		uint64_t length;
+		if (!readVarint(in, offset, length) || length > in.size() - offset)
+			return false;
+		out.assign(in.data() + offset, length);
+		offset += length;
+		return true;
+	}
+	static void appendUint32(std::string& out, uint32_t value) {
+		for (int i = 0; i < 4; i++)
+			out += (char)(value >> (8 * i) & 0xFF);
+	}
+	static uint32_t readUint32(const char* data) {
+		uint32_t value = 0;
+		for (int i = 0; i < 4; i++)
+			value |= (uint32_t)(unsigned char)data[i] << (8 * i);
+		return value;
+	}
+};
+
+//швидке блокове стиснення у форматі блоку LZ4: послідовності [токен: довжини літералів і збігу по 4 біти][довжини, що не вмістились]
+//[літерали][зміщення збігу, 2 байти][решта довжини збігу]. Збіги шукаються за хеш-таблицею 4-байтових послідовностей без повторних перевірок
+class BlockCompressor {
+private:
+	static const int HASH_LOG = 12;
+	static const size_t MIN_MATCH = 4,
+		LAST_LITERALS = 5, //останні байти блоку завжди лишаються літералами, як того вимагає формат
+		MATCH_SEARCH_LIMIT = 12, //і збіги не починаються ближче до кінця
+		MAX_OFFSET = 65535,
+		MAX_EXPANSION = 255; //кожен байт продовження довжини збігу дає щонайбільше 255 байтів, тож розпаковане не більше за стиснуте стільки разів
+
+	static uint32_t read32(const char* data) {
+		uint32_t value;
+		memcpy(&value, data, 4);
+		return value;
+	}
+	static uint32_t hashOf(uint32_t sequence) { return (sequence * 2654435761u) >> (32 - HASH_LOG); }
+	static void appendLength(std::string& out, size_t length) {
+		for (; length >= 255; length -= 255)
+			out += (char)255;
+		out += (char)length;
+	}
+	static void appendSequence(std::string& out, const char* literals, size_t countOfLiterals, size_t offset, size_t lengthOfMatch) {
+		size_t extraOfMatch = lengthOfMatch - MIN_MATCH;
+		out += (char)((std::min<size_t>(countOfLiterals, 15) << 4) | std::min<size_t>(extraOfMatch, 15));
+		if (countOfLiterals >= 15)
+			appendLength(out, countOfLiterals - 15);
+		out.append(literals, countOfLiterals);
+		out += (char)(offset & 0xFF);
+		out += (char)(offset >> 8);
+		if (extraOfMatch >= 15)
+			appendLength(out, extraOfMatch - 15);
+	}
+	static bool readLength(std::string_view in, size_t& offset, size_t& length) {
+		unsigned char byte;
+		do {
+			if (offset >= in.size())
+				return false;
+			byte = in[offset++];
+			length += byte;
+		} while (byte == 255);
+		return true;
+	}
+
+public:
+	static void compress(const char* data, size_t length, std::string& out) {
+		std::vector<uint32_t> table(1 << HASH_LOG, 0);
+		size_t anchor = 0, position = 1;
+
+		if (length > MATCH_SEARCH_LIMIT) {
+			table[hashOf(read32(data))] = 0;
+			while (position + MATCH_SEARCH_LIMIT <= length) {
+				uint32_t sequence = read32(data + position), hash = hashOf(sequence);
+				size_t candidate = table[hash];
+				table[hash] = (uint32_t)position;
+
+				if (position - candidate > MAX_OFFSET || read32(data + candidate) != sequence) {
+					position++;
+					continue;
+				}
+
+				size_t lengthOfMatch = MIN_MATCH, limit = length - LAST_LITERALS;
+				while (position + lengthOfMatch < limit && data[candidate + lengthOfMatch] == data[position + lengthOfMatch])
+					lengthOfMatch++;
+				//збіг можна продовжити назад за рахунок ще не записаних літералів
+				while (position > anchor && candidate > 0 && data[position - 1] == data[candidate - 1]) {
+					position--;
+					candidate--;
+					lengthOfMatch++;
+				}
+
+				appendSequence(out, data + anchor, position - anchor, position - candidate, lengthOfMatch);
+				position += lengthOfMatch;
+				anchor = position;
+				if (position >= 2 && position + MATCH_SEARCH_LIMIT <= length)
+					table[hashOf(read32(data + position - 2))] = (uint32_t)(position - 2);
+			}
+		}
+
+		size_t countOfLiterals = length - anchor;
+		out += (char)(std::min<size_t>(countOfLiterals, 15) << 4);
+		if (countOfLiterals >= 15)
+			appendLength(out, countOfLiterals - 15);
+		out.append(data + anchor, countOfLiterals);
+	}
+	//lengthOfOriginal відома із заголовка, тож пошкоджений блок, що вийшов би за неї, відкидається. Пошкоджений заголовок з довжиною,
+	//недосяжною для блоку такого розміру, відкидається ще до виділення пам'яті під неї
+	static bool decompress(std::string_view in, size_t lengthOfOriginal, std::string& out) {
+		if (lengthOfOriginal / MAX_EXPANSION > in.size() + 1)
+			return false;
+		out.resize(lengthOfOriginal);
+		size_t offset = 0, written = 0;
+
+		while (offset < in.size()) {
+			unsigned char token = in[offset++];
+			size_t countOfLiterals = token >> 4;
+			if (countOfLiterals == 15 && !readLength(in, offset, countOfLiterals))
+				return false;
+			if (countOfLiterals > in.size() - offset || countOfLiterals > lengthOfOriginal - written)
+				return false;
+			memcpy(out.data() + written, in.data() + offset, countOfLiterals);
+			offset += countOfLiterals;
+			written += countOfLiterals;
+
+			if (offset == in.size())
+				break;
+			if (in.size() - offset < 2)
+				return false;
+			size_t distance = (unsigned char)in[offset] | (size_t)(unsigned char)in[offset + 1] << 8;
+			offset += 2;
+			size_t lengthOfMatch = token & 15;
+			if (lengthOfMatch == 15 && !readLength(in, offset, lengthOfMatch))
+				return false;
+			lengthOfMatch += MIN_MATCH;
+			if (distance == 0 || distance > written || lengthOfMatch > lengthOfOriginal - written)
+				return false;
+
+			//збіг може перекриватись з тим, що копіюється, тому побайтово
+			char* destination = out.data() + written;
+			for (size_t i = 0; i < lengthOfMatch; i++)
+				destination[i] = destination[i - distance];
+			written += lengthOfMatch;
+		}
+		return written == lengthOfOriginal;
+	}
+};
+
+//Continue - коротка правка, злита з останньою командою історії (набір тексту), а не окрема команда
+enum class JournalOpcode : unsigned char { Paste = 1, Cut, Delete, Undo, Redo, ReplaceAll, Continue };
+
+class CommandsJournal {
+private:
+	static const std::string SIGNATURE, //заголовок, з якого починається кожен файл журналу
+		COMPRESSED_SIGNATURE; //заголовок журналу, в якому зміни записів можуть бути стиснуті
+	static const bool SHOULD_COMPRESS; //чи стискати нові журнали; старі дописуються у своєму форматі
+	static const size_t MIN_SIZE_TO_COMPRESS = 64; //коротші зміни (набір тексту) стискати немає сенсу
+
+	std::string filepath; //шлях до файлу журналу
+	std::ofstream stream; //файл журналу, відкритий на дописування; відкривається лише при першому записі
+	bool isCompressed; //формат відкритого файлу, визначений за його заголовком
+
+	//у стиснутому журналі після коду операції йде спосіб запису змін: 0 - як є, 1 - [довжина до стиснення (varint)][стиснутий блок]
+	static void compressChanges(std::string& body) {
+		std::string compressed;
+		size_t sizeOfChanges = body.size() - 1;
+
+		if (sizeOfChanges >= MIN_SIZE_TO_COMPRESS) {
+			compressed += body[0];
+			compressed += (char)1;
+			BinaryFormat::appendVarint(compressed, sizeOfChanges);
+			BlockCompressor::compress(body.data() + 1, sizeOfChanges, compressed);
+		}
+		if (!compressed.empty() && compressed.size() < body.size())
+			body.swap(compressed);
+		else
+			body.insert(body.begin() + 1, (char)0);
+	}
+	//повертає тіло в звичайному форматі: або саме тіло, або розпаковане в buffer
+	static bool decompressChanges(std::string_view body, std::string& buffer, std::string_view& result) {
+		if (body.size() < 2 || (body[1] != 0 && body[1] != 1))
+			return false;
+
+		if (body[1] == 0) {
+			buffer.assign(1, body[0]);
+			buffer.append(body.data() + 2, body.size() - 2);
+			result = buffer;
+			return true;
+		}
+
+		size_t offset = 2;
+		uint64_t sizeOfChanges;
+		std::string changes;
+		if (!BinaryFormat::readVarint(body, offset, sizeOfChanges) || !BlockCompressor::decompress(body.substr(offset), sizeOfChanges, changes))
+			return false;
+		buffer.assign(1, body[0]);
+		buffer += changes;
+		result = buffer;
+		return true;
+	}
+
+public:
+	CommandsJournal(std::string filepath) : filepath(filepath), isCompressed(SHOULD_COMPRESS) {}
+
+	//запис: [довжина тіла (varint)][тіло: код операції, для змін - позиція і довжини з байтами тексту][CRC32 тіла];
+	//у масової заміни перед змінами ще записується їх кількість
+	static std::string encodeRecord(JournalOpcode opcode, const TextDelta* deltas = nullptr, size_t countOfDeltas = 1, bool isCompressed = SHOULD_COMPRESS) {
+		std::string body, record;
+
+		body += (char)opcode;
+		if (opcode == JournalOpcode::ReplaceAll)
+			BinaryFormat::appendVarint(body, countOfDeltas);
+		if (opcode != JournalOpcode::Undo && opcode != JournalOpcode::Redo) {
+			for (size_t i = 0; i < countOfDeltas; i++) {
+				BinaryFormat::appendVarint(body, deltas[i].position);
+				BinaryFormat::appendVarint(body, deltas[i].removedText.size());
+				body += deltas[i].removedText;
+				BinaryFormat::appendVarint(body, deltas[i].insertedText.size());
+				body += deltas[i].insertedText;
+			}
+		}
+		if (isCompressed)
+			compressChanges(body);
+
+		BinaryFormat::appendVarint(record, body.size());
+		record += body;
+		BinaryFormat::appendUint32(record, BinaryFormat::crc32(body.data(), body.size()));
+		return record;
+	}
+
+	bool open() {
+		if (stream.is_open())
+			return true;
+
+		bool isNewFile = !std::filesystem::exists(filepath) || std::filesystem::file_size(filepath) == 0;
+		if (!isNewFile) {
+			std::ifstream existing(filepath, std::ios::binary);
+			std::string signature(COMPRESSED_SIGNATURE.size(), '\0');
+			existing.read(signature.data(), signature.size());
+			isCompressed = signature == COMPRESSED_SIGNATURE;
+		}
+		else
+			isCompressed = SHOULD_COMPRESS;
+
+		stream.open(filepath, std::ios::binary | std::ios::app);
+		if (!stream.is_open())
+			return false;
+
+		if (isNewFile) {
+			stream << (isCompressed ? COMPRESSED_SIGNATURE : SIGNATURE);
+			stream.flush();
+		}
+		return true;
+	}
+	void close() {
+		if (stream.is_open())
+			stream.close();
+	}
+	void append(JournalOpcode opcode, const TextDelta* deltas = nullptr, size_t countOfDeltas = 1) {
+		TraceScope trace("CommandsJournal::append");
+		if (!open())
+			return;
+
+		std::string record = encodeRecord(opcode, deltas, countOfDeltas, isCompressed);
+		stream.write(record.data(), record.size());
+		stream.flush();
+	}
+
+	std::string getFilepath() { return filepath; }
+
+	//читає записи журналу по порядку; пошкоджений або недописаний хвіст (наприклад, після аварійного завершення) відрізається.
+	//Якщо зміни не потрібні (лише підрахунок команд), тексти записів не розбираються, не розпаковуються і не копіюються.
+	//Стиснуті записи розпаковуються по одному, тож пам'ять потрібна лише під поточний запис
+	static int replay(std::string filepath, std::function<void(JournalOpcode, std::vector<TextDelta>&)> onRecord, bool shouldDecodeDeltas = true) {
+		MappedFile file;
+		if (!file.open(filepath))
+			return -1;
+
+		std::string_view content(file.data() ? file.data() : "", file.size());
+		bool isCompressed = content.substr(0, COMPRESSED_SIGNATURE.size()) == COMPRESSED_SIGNATURE;
+		if (!isCompressed && content.substr(0, SIGNATURE.size()) != SIGNATURE)
+			return -1;
+
+		size_t offset = SIGNATURE.size(), endOfValidRecords = offset;
+		int countOfRecords = 0;
+		std::string buffer;
+
+		while (offset < content.size()) {
+			uint64_t lengthOfBody;
+			//довжина порівнюється з рештою файлу без додавання, бо пошкоджений varint може бути близьким до максимуму
+			if (!BinaryFormat::readVarint(content, offset, lengthOfBody) || lengthOfBody == 0 ||
+				lengthOfBody > content.size() - offset || content.size() - offset - lengthOfBody < 4)
+				break;
+
+			size_t startOfBody = offset;
+			uint32_t checksum = BinaryFormat::readUint32(content.data() + startOfBody + lengthOfBody);
+			if (checksum != BinaryFormat::crc32(content.data() + startOfBody, lengthOfBody))
+				break;
+
+			std::string_view body = content.substr(startOfBody, lengthOfBody);
+			size_t offsetInBody = 1;
+			JournalOpcode opcode = (JournalOpcode)body[0];
+			if (opcode < JournalOpcode::Paste || opcode > JournalOpcode::Continue)
+				break;
+			std::vector<TextDelta> deltas;
+			uint64_t countOfDeltas = 1, position;
+			if (shouldDecodeDeltas && opcode != JournalOpcode::Undo && opcode != JournalOpcode::Redo) {
+				if (isCompressed && !decompressChanges(body, buffer, body))
+					break;
+				if (opcode == JournalOpcode::ReplaceAll && !BinaryFormat::readVarint(body, offsetInBody, countOfDeltas))
+					break;
+
+				bool isRecordValid = true;
+				for (uint64_t i = 0; i < countOfDeltas && isRecordValid; i++) {
+					TextDelta delta;
+					isRecordValid = BinaryFormat::readVarint(body, offsetInBody, position) &&
+						BinaryFormat::readBytes(body, offsetInBody, delta.removedText) &&
+						BinaryFormat::readBytes(body, offsetInBody, delta.insertedText);
+					delta.position = position;
+					deltas.push_back(std::move(delta));
+				}
+				if (!isRecordValid)
+					break;
+			}
+
+			offset = startOfBody + lengthOfBody + 4;
+			endOfValidRecords = offset;
+			countOfRecords++;
+			onRecord(opcode, deltas);
+		}
+
+		size_t sizeOfFile = content.size();
+		file.close();
+
+		if (endOfValidRecords < sizeOfFile)
+			std::filesystem::resize_file(filepath, endOfValidRecords);
+
+		return countOfRecords;
+	}
+	//атомарно замінює журнал новим, що містить лише передані записи (закодовані з типовим стисненням)
+	static bool rewrite(std::string filepath, const std::vector<std::string>& records) {
+		std::string temporaryFilepath = filepath + ".tmp";
+		std::ofstream file(temporaryFilepath, std::ios::binary | std::ios::trunc);
+
+		if (!file.is_open())
+			return false;
+
+		file << (SHOULD_COMPRESS ? COMPRESSED_SIGNATURE : SIGNATURE);
+		for (const std::string& record : records)
+			file.write(record.data(), record.size());
+		file.close();
+
+		std::error_code error;
+		std::filesystem::rename(temporaryFilepath, filepath, error);
+		return !error;
+	}
+};
+
+const std::string CommandsJournal::SIGNATURE = "CTEJ\x01",
+CommandsJournal::COMPRESSED_SIGNATURE = "CTEJ\x02";
+const bool CommandsJournal::SHOULD_COMPRESS = true;
+
+//відображення в консолі: все, що пишеться в std::cout, збирається в модель екрана (рядки з урахуванням ширини вікна),
+//а при скиданні потоку в консоль одним записом надсилаються лише змінені рядки у вигляді ANSI-послідовностей.
+//Якщо кадр не вміщається у вікно, він просто дописується, як у звичайному терміналі
+class ConsoleRenderer : public std::streambuf {
+private:
+	//введене користувачем консоль показує сама, тож його потрібно лише додати в модель екрана
+	class InputEcho : public std::streambuf {
+	private:
+		std::streambuf* consoleInput;
+		char symbol;
+
+	protected:
+		int underflow() override {
+			int next = consoleInput->sbumpc();
+			if (next == EOF)
+				return EOF;
+
+			symbol = (char)next;
+			setg(&symbol, &symbol, &symbol + 1);
+			instance->appendEcho(symbol);
+			return next;
+		}
+
+	public:
+		InputEcho(std::streambuf* consoleInput) : consoleInput(consoleInput) { }
+	};
+
+	static ConsoleRenderer* instance;
+	static InputEcho* inputEcho;
+
+	std::streambuf* consoleOutput; //справжній буфер std::cout, через який кадр виводиться в консоль
+	std::streambuf* consoleInput;
+	std::vector<std::string> rowsOnScreen; //що зараз показано у вікні консолі
+	std::vector<std::string> rowsOfFrame; //що має бути показано після скидання поточного кадру
+	std::string textOfFrame; //вивід поточного кадру як є, для випадку, коли кадр не вміщається у вікно
+	size_t sizeOfEmittedText; //скільки з textOfFrame вже виведено в консоль
+	bool isFrameScrolling; //кадр вийшов за висоту вікна і виводиться дописуванням
+	bool shouldClearScreen;
+	size_t widthOfConsole, heightOfConsole;
+
+	ConsoleRenderer(std::streambuf* consoleOutput, std::streambuf* consoleInput) : consoleOutput(consoleOutput), consoleInput(consoleInput),
+		sizeOfEmittedText(0), isFrameScrolling(false), shouldClearScreen(true), widthOfConsole(80), heightOfConsole(25) {
+		rowsOfFrame.push_back("");
+		updateSizeOfConsole();
+	}
+
+	void updateSizeOfConsole() {
+		CONSOLE_SCREEN_BUFFER_INFO info;
+		if (GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info)) {
+			widthOfConsole = std::max(1, info.srWindow.Right - info.srWindow.Left + 1);
+			heightOfConsole = std::max(1, info.srWindow.Bottom - info.srWindow.Top + 1);
+		}
+	}
+	//консоль переносить рядок лише тоді, коли після заповненого рядка з'являється ще один символ
+	void appendToRows(std::vector<std::string>& rows, char symbol) {
+		if (symbol == '\n') {
+			rows.push_back("");
+			return;
+		}
+		if (symbol == '\r')
+			return;
+
+		if (rows.back().size() == widthOfConsole)
+			rows.push_back("");
+		if (symbol == '\t')
+			rows.back().append(std::min(8 - rows.back().size() % 8, widthOfConsole - rows.back().size()), ' ');
+		else
+			rows.back() += symbol;
+	}
+	void appendToFrame(const char* text, size_t length) {
+		textOfFrame.append(text, length);
+		for (size_t i = 0; i < length; i++)
+			appendToRows(rowsOfFrame, text[i]);
+	}
+	void appendEcho(char symbol) {
+		appendToFrame(&symbol, 1);
+		sizeOfEmittedText = textOfFrame.size();
+		if (!isFrameScrolling)
+			appendToRows(rowsOnScreen, symbol);
+
+		//введення в останньому рядку вікна прокрутило консоль, тож рядки моделі вже не збігаються з рядками вікна
+		if (!isFrameScrolling && rowsOnScreen.size() > heightOfConsole)
+			isFrameScrolling = true;
+	}
+
+	void render() {
+		std::string output;
+
+		if (!isFrameScrolling && rowsOfFrame.size() > heightOfConsole) {
+			isFrameScrolling = true;
+			output += "\x1b[H\x1b[2J\x1b[3J" + textOfFrame;
+		}
+		else if (isFrameScrolling)
+			output += textOfFrame.substr(sizeOfEmittedText);
+		else {
+			if (shouldClearScreen) {
+				output += "\x1b[H\x1b[2J\x1b[3J";
+				rowsOnScreen.clear();
+				shouldClearScreen = false;
+			}
+
+			for (size_t row = 0; row < rowsOfFrame.size(); row++)
+				if (row >= rowsOnScreen.size() || rowsOnScreen[row] != rowsOfFrame[row])
+					output += "\x1b[" + std::to_string(row + 1) + ";1H" + rowsOfFrame[row] + "\x1b[K";
+			if (rowsOnScreen.size() > rowsOfFrame.size())
+				output += "\x1b[" + std::to_string(rowsOfFrame.size() + 1) + ";1H\x1b[J";
+			output += "\x1b[" + std::to_string(rowsOfFrame.size()) + ";" + std::to_string(rowsOfFrame.back().size() + 1) + "H";
+			rowsOnScreen = rowsOfFrame;
+		}
+
+		sizeOfEmittedText = textOfFrame.size();
+		consoleOutput->sputn(output.data(), output.size());
+		consoleOutput->pubsync();
+	}
+
+protected:
+	int overflow(int symbol) override {
+		if (symbol != EOF) {
+			char data = (char)symbol;
+			appendToFrame(&data, 1);
+		}
+		return symbol;
+	}
+	std::streamsize xsputn(const char* text, std::streamsize length) override {
+		appendToFrame(text, length);
+		return length;
+	}
+	int sync() override {
+		render();
+		return 0;
+	}
+
+public:
+	//вмикає рендерер, лише якщо вивід іде в консоль з підтримкою ANSI-послідовностей
+	static void install() {
+		HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE), input = GetStdHandle(STD_INPUT_HANDLE);
+		DWORD mode;
+		if (instance || !GetConsoleMode(output, &mode) || !SetConsoleMode(output, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING))
+			return;
+
+		std::cout.flush();
+		instance = new ConsoleRenderer(std::cout.rdbuf(), std::cin.rdbuf());
+		std::cout.rdbuf(instance);
+		if (GetConsoleMode(input, &mode)) {
+			inputEcho = new InputEcho(std::cin.rdbuf());
+			std::cin.rdbuf(inputEcho);
+		}
+	}
+	static void uninstall() {
+		if (!instance)
+			return;
+
+		std::cout.flush();
+		std::cout.rdbuf(instance->consoleOutput);
+		std::cin.rdbuf(instance->consoleInput);
+		delete inputEcho;
+		delete instance;
+		inputEcho = nullptr;
+		instance = nullptr;
+	}
+
+	//початок нового екрана замість system("cls"): старий вміст буде замінено під час наступного скидання
+	static void beginFrame() {
+		TraceScope trace("ConsoleRenderer::beginFrame");
+		if (!instance) {
+			DWORD mode;
+			if (GetConsoleMode(GetStdHandle(STD_OUTPUT_HANDLE), &mode))
+				system("cls"); //консоль без підтримки ANSI-послідовностей
+			return;
+		}
+
+		instance->updateSizeOfConsole();
+		instance->shouldClearScreen = instance->shouldClearScreen || instance->isFrameScrolling;
+		instance->isFrameScrolling = false;
+		instance->rowsOfFrame.assign(1, "");
+		instance->textOfFrame.clear();
+		instance->sizeOfEmittedText = 0;
+	}
+	//замість system("pause"), без запуску окремого процесу
+	static void waitForKey() {
+		DWORD mode;
+		std::cout << "Для продовження натисніть будь-яку клавішу . . . ";
+		std::cout.flush();
+		if (GetConsoleMode(GetStdHandle(STD_INPUT_HANDLE), &mode))
+			_getch();
+		std::cout << "\n";
+	}
+	//скільки рядків вікна можна зайняти, залишивши reservedRows; 0 - вивід не в консоль, обмеження немає
+	static size_t getCountOfFreeRows(size_t reservedRows) {
+		if (!instance)
+			return 0;
+		return instance->heightOfConsole > reservedRows ? instance->heightOfConsole - reservedRows : 1;
+	}
+	static size_t getWidthOfConsole() { return instance ? instance->widthOfConsole : 0; }
+};
+
+ConsoleRenderer* ConsoleRenderer::instance = nullptr;
+ConsoleRenderer::InputEcho* ConsoleRenderer::inputEcho = nullptr;
+
+//буфер обміну сеансу, обмежений кількістю записів і їх сумарним розміром. Записи не копіюють текст: це фрагменти буфера тексту,
+//що ділять з ним байти, або ділянки відображеного в пам'ять файлу, в якому буфер обміну зберігся при минулому запуску
+class Clipboard {
+private:
+	struct Entry {
+		std::shared_ptr<const TextBuffer> text; //фрагмент тексту документа
+		std::shared_ptr<const MappedFile> file; //або файл буфера обміну, в якому лежать байти запису
+		size_t offsetInFile = 0, length = 0;
+		uint32_t checksum = 0; //для фрагмента тексту рахується лише тоді, коли з'являється запис такої ж довжини
+		bool hasChecksum = false;
+	};
+
+	static const std::string SIGNATURE; //заголовок файлу буфера обміну
+	static const size_t MAX_COUNT_OF_ENTRIES = 64, MAX_SIZE_IN_BYTES = 256 * 1024 * 1024;
+
+	std::deque<Entry> entries; //від найдавнішого запису до найновішого
+	size_t sizeInBytes;
+	std::string filepath; //де буфер обміну зберігається між запусками; порожній, якщо зберігати не потрібно
+	bool isLoaded, isChanged;
+
+	static void forEachPieceOf(const Entry& entry, size_t position, size_t count, const std::function<bool(const char*, size_t)>& action) {
+		if (entry.text)
+			entry.text->forEachPiece(position, count, action);
+		else if (position < entry.length)
+			action(entry.file->data() + entry.offsetInFile + position, std::min(count, entry.length - position));
+	}
+	static uint32_t checksumOf(Entry& entry) {
+		if (!entry.hasChecksum) {
+			entry.checksum = 0;
+			forEachPieceOf(entry, 0, entry.length, [&entry](const char* data, size_t length) {
+				entry.checksum = BinaryFormat::crc32(data, length, entry.checksum);
+				return true;
+				});
+			entry.hasChecksum = true;
+		}
+		return entry.checksum;
+	}
+	static bool areEqual(Entry& first, Entry& second) {
+		if (first.length != second.length || checksumOf(first) != checksumOf(second))
+			return false;
+
+		bool isEqual = true;
+		size_t position = 0;
+		forEachPieceOf(first, 0, first.length, [&](const char* data, size_t length) {
+			forEachPieceOf(second, position, length, [&](const char* otherData, size_t otherLength) {
+				isEqual = memcmp(data, otherData, otherLength) == 0;
+				data += otherLength;
+				return isEqual;
+				});
+			position += length;
+			return isEqual;
+			});
+		return isEqual;
+	}
+
+	//файл: [заголовок], далі записи [довжина (varint)][CRC32 тексту][текст]. Тексти не копіюються - вони залишаються
+	//у відображенні файлу, а лише звіряються з сумами, тож недописаний або пошкоджений хвіст відкидається, як і в журналі
+	void ensureLoaded() {
+		if (isLoaded)
+			return;
+		isLoaded = true;
+
+		std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+		if (filepath.empty() || !file->open(filepath) || file->size() == 0)
+			return;
+
+		std::string_view content(file->data(), file->size());
+		if (content.substr(0, SIGNATURE.size()) != SIGNATURE)
+			return;
+
+		size_t offset = SIGNATURE.size();
+		uint64_t length;
+		while (offset < content.size() && BinaryFormat::readVarint(content, offset, length) && length > 0 &&
+			length <= content.size() - offset && content.size() - offset - length >= 4) {
+			Entry entry;
+			entry.file = file;
+			entry.checksum = BinaryFormat::readUint32(content.data() + offset);
+			if (entry.checksum != BinaryFormat::crc32(content.data() + offset + 4, length))
+				break;
+			entry.hasChecksum = true;
+			entry.offsetInFile = offset + 4;
+			entry.length = length;
+			offset += 4 + length;
+
+			entries.push_back(entry);
+			sizeInBytes += length;
+		}
+	}
+	void addEntry(Entry& entry) {
+		ensureLoaded();
+		isChanged = true;
+
+		//однаковий запис не дублюється, а лише стає найновішим
+		for (size_t i = 0; i < entries.size(); i++) {
+			if (areEqual(entries[i], entry)) {
+				Entry existing = entries[i];
+				entries.erase(entries.begin() + i);
+				entries.push_back(existing);
+				return;
+			}
+		}
+
+		entries.push_back(entry);
+		sizeInBytes += entry.length;
+		while (entries.size() > MAX_COUNT_OF_ENTRIES || (sizeInBytes > MAX_SIZE_IN_BYTES && entries.size() > 1)) {
+			sizeInBytes -= entries.front().length;
+			entries.pop_front();
+		}
+	}
+
+public:
+	Clipboard() : sizeInBytes(0), isLoaded(true), isChanged(false) {}
+
+	//буфер обміну, збережений у файлі, читається лише при першому зверненні до нього
+	void setFilepath(std::string filepath) {
+		this->filepath = filepath;
+		isLoaded = entries.empty() ? false : isLoaded;
+	}
+
+	void add(const TextBuffer* text, size_t position, size_t count) {
+		Entry entry;
+		entry.text = std::make_shared<const TextBuffer>(text->slice(position, count));
+		entry.length = entry.text->size();
+		addEntry(entry);
+	}
+
+	int size() {
+		ensureLoaded();
+		return entries.size();
+	}
+	size_t getSizeInBytes() {
+		ensureLoaded();
+		return sizeInBytes;
+	}
+	//на відміну від getSizeInBytes не завантажує буфер: ще не прочитаний з файлу буфер пам'яті не займає
+	size_t getSizeInMemory() const { return isLoaded ? sizeInBytes : 0; }
+	//індекс 0 - найдавніший запис
+	std::string getByIndex(int index, size_t maxLength = std::string::npos) {
+		ensureLoaded();
+		std::string result;
+		forEachPieceOf(entries[index], 0, std::min(maxLength, entries[index].length), [&result](const char* data, size_t length) {
+			result.append(data, length);
+			return true;
+			});
+		return result;
+	}
+
+	//атомарно переписує файл; після цього записи знову читаються з нового файлу, щоб старе відображення не тримало його
+	bool save() {
+		if (filepath.empty() || !isChanged)
+			return true;
+
+		if (entries.empty()) {
+			remove(filepath.c_str());
+			isChanged = false;
+			return true;
+		}
+
+		std::string temporaryFilepath = filepath + ".tmp";
+		std::ofstream file(temporaryFilepath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			return false;
+
+		file << SIGNATURE;
+		for (Entry& entry : entries) {
+			std::string header;
+			BinaryFormat::appendVarint(header, entry.length);
+			BinaryFormat::appendUint32(header, checksumOf(entry));
+			file.write(header.data(), header.size());
+			forEachPieceOf(entry, 0, entry.length, [&file](const char* data, size_t length) {
+				file.write(data, length);
+				return true;
+				});
+		}
+		file.close();
+		if (!file) {
+			remove(temporaryFilepath.c_str());
+			return false;
+		}
+
+		entries.clear();
+		sizeInBytes = 0;
+		isLoaded = false;
+		isChanged = false;
+
+		std::error_code error;
+		std::filesystem::rename(temporaryFilepath, filepath, error);
+		return !error;
+	}
+};
+
+const std::string Clipboard::SIGNATURE = "CTEC\x01";
+
+enum class CommandType : unsigned char { Copy, Paste, Cut, Delete, ReplaceAll, Undo, Redo };
+
+//сховище фрагментів тексту, що адресуються своїм вмістом. Текст ріжеться там, де ковзний хеш останніх байтів набуває
+//певного значення, тож межі залежать від вмісту, а не від зміщень: однакові частини різних текстів (вставлений шаблон,
+//вирізаний і знову вставлений фрагмент) дають однакові фрагменти, і кожен унікальний фрагмент зберігається один раз.
+//Фрагменти рахують посилання; коли їх байти перевищують бюджет, давно не читані витісняються у файл, куди кожен
+//фрагмент записується теж лише один раз
+class ChunkStore {
+public:
+	typedef uint64_t ChunkId;
+
+private:
+	static const size_t MIN_SIZE_OF_CHUNK = 2 * 1024, MAX_SIZE_OF_CHUNK = 64 * 1024;
+	static const uint64_t BOUNDARY_MASK = 0x1FFFull << 51; //13 старших бітів хешу: межа в середньому через 8 КБ після мінімуму
+	static const uint64_t NOT_IN_FILE = UINT64_MAX;
+
+	struct Chunk {
+		std::string bytes; //порожній, якщо фрагмент витіснено у файл
+		size_t length, countOfReferences;
+		uint64_t offsetInFile, lastUse;
+	};
+
+	std::mutex lock; //сховище спільне для історій усіх сеансів
+	std::unordered_map<ChunkId, Chunk> chunks;
+	size_t sizeInMemory, sizeOfReferencedText; //байти унікальних фрагментів у пам'яті і сумарний обсяг текстів, що на них посилаються
+	size_t memoryBudget; //0 - без обмеження
+	uint64_t counterOfUses, endOfFile;
+	std::string filepath;
+	std::fstream file; //відкривається лише при першому витісненні
+
+	//випадкові, але сталі значення для кожного байта, з яких складається ковзний хеш
+	static const uint64_t* gearTable() {
+		static const std::vector<uint64_t> table = []() {
+			std::vector<uint64_t> values(256);
+			uint64_t state = 0x9E3779B97F4A7C15ull;
+			for (uint64_t& value : values) {
+				uint64_t mixed = (state += 0x9E3779B97F4A7C15ull);
+				mixed = (mixed ^ (mixed >> 30)) * 0xBF58476D1CE4E5B9ull;
+				mixed = (mixed ^ (mixed >> 27)) * 0x94D049BB133111EBull;
+				value = mixed ^ (mixed >> 31);
+			}
+			return values;
+			}();
+		return table.data();
+	}
+	//зсув на біт за байт означає, що хеш залежить лише від останніх 64 байтів
+	static size_t lengthOfNextChunk(const char* data, size_t length) {
+		if (length <= MIN_SIZE_OF_CHUNK)
+			return length;
+
+		const uint64_t* gear = gearTable();
+		size_t limit = length < MAX_SIZE_OF_CHUNK ? length : MAX_SIZE_OF_CHUNK;
+		uint64_t hash = 0;
+		for (size_t i = MIN_SIZE_OF_CHUNK - 64; i < limit; i++) {
+			hash = (hash << 1) + gear[(unsigned char)data[i]];
+			if (i >= MIN_SIZE_OF_CHUNK && (hash & BOUNDARY_MASK) == 0)
+				return i + 1;
+		}
+		return limit;
+	}
+	static ChunkId idOf(std::string_view bytes) {
+		uint64_t hash = 0xCBF29CE484222325ull;
+		for (unsigned char byte : bytes)
+			hash = (hash ^ byte) * 0x100000001B3ull;
+		return hash;
+	}
+
+	//false, якщо витіснений фрагмент не вдалося прочитати з файлу повністю
+	bool bytesOf(Chunk& chunk, std::string& buffer, std::string_view& bytes) {
+		chunk.lastUse = ++counterOfUses;
+		if (!chunk.bytes.empty() || chunk.length == 0) {
+			bytes = chunk.bytes;
+			return true;
+		}
+		if (!file.is_open())
+			return false;
+
+		buffer.resize(chunk.length);
+		file.clear();
+		if (!file.seekg(chunk.offsetInFile) || !file.read(buffer.data(), chunk.length))
+			return false;
+		bytes = buffer;
+		return true;
+	}
+	//витісняє давно не читані фрагменти, поки в пам'яті не залишиться половина бюджету
+	void spillIfOverBudget() {
+		if (memoryBudget == 0 || filepath.empty() || sizeInMemory <= memoryBudget)
+			return;
+
+		if (!file.is_open()) {
+			std::filesystem::path parent = std::filesystem::path(filepath).parent_path();
+			if (!parent.empty() && !std::filesystem::exists(parent))
+				std::filesystem::create_directories(parent);
+			file.open(filepath, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+			if (!file.is_open())
+				return;
+		}
+
+		std::vector<Chunk*> residentChunks;
+		for (auto& [id, chunk] : chunks)
+			if (!chunk.bytes.empty())
+				residentChunks.push_back(&chunk);
+		std::sort(residentChunks.begin(), residentChunks.end(), [](Chunk* a, Chunk* b) { return a->lastUse < b->lastUse; });
+
+		for (size_t i = 0; i < residentChunks.size() && sizeInMemory > memoryBudget / 2; i++) {
+			Chunk* chunk = residentChunks[i];
+			if (chunk->offsetInFile == NOT_IN_FILE) {
+				file.seekp(endOfFile);
+				file.write(chunk->bytes.data(), chunk->length);
+				if (!file) {
+					file.clear();
+					break;
+				}
+				chunk->offsetInFile = endOfFile;
+				endOfFile += chunk->length;
+			}
+			sizeInMemory -= chunk->length;
+			std::string().swap(chunk->bytes);
+		}
+		file.flush();
+	}
+
+public:
+	ChunkStore(std::string filepath = "", size_t memoryBudget = 0) : sizeInMemory(0), sizeOfReferencedText(0), memoryBudget(memoryBudget),
+		counterOfUses(0), endOfFile(0), filepath(filepath) {}
+
+	//ріже текст на фрагменти, додає посилання на кожен і дописує їх ідентифікатори в references
+	void put(std::string_view text, std::vector<ChunkId>& references) {
+		std::lock_guard<std::mutex> guard(lock);
+		std::string buffer;
+
+		sizeOfReferencedText += text.size();
+		for (size_t offset = 0; offset < text.size();) {
+			std::string_view bytes = text.substr(offset, lengthOfNextChunk(text.data() + offset, text.size() - offset));
+			offset += bytes.size();
+
+			//при збігу хешів різних фрагментів береться наступний вільний ідентифікатор
+			//фрагмент, який не вдалося прочитати, вважається іншим
+			ChunkId id = idOf(bytes);
+			auto found = chunks.find(id);
+			std::string_view existing;
+			while (found != chunks.end() && (found->second.length != bytes.size() || !bytesOf(found->second, buffer, existing) || existing != bytes))
+				found = chunks.find(++id);
+
+			if (found != chunks.end())
+				found->second.countOfReferences++;
+			else {
+				chunks.emplace(id, Chunk{ std::string(bytes), bytes.size(), 1, NOT_IN_FILE, ++counterOfUses });
+				sizeInMemory += bytes.size();
+			}
+			references.push_back(id);
+		}
+		spillIfOverBudget();
+	}
+	//місце витіснених фрагментів у файлі не звільняється: файл потрібен лише до завершення програми
+	void release(const ChunkId* references, size_t countOfReferences) {
+		std::lock_guard<std::mutex> guard(lock);
+		for (size_t i = 0; i < countOfReferences; i++) {
+			auto found = chunks.find(references[i]);
+			if (found == chunks.end())
+				continue;
+
+			sizeOfReferencedText -= found->second.length;
+			if (--found->second.countOfReferences == 0) {
+				sizeInMemory -= found->second.bytes.size();
+				chunks.erase(found);
+			}
+		}
+	}
+	//false, якщо якогось фрагмента немає або його не вдалося прочитати; тоді out неповний і використовувати його не можна
+	bool read(const ChunkId* references, size_t countOfReferences, std::string& out) {
+		std::lock_guard<std::mutex> guard(lock);
+		std::string buffer;
+		std::string_view bytes;
+		for (size_t i = 0; i < countOfReferences; i++) {
+			auto found = chunks.find(references[i]);
+			if (found == chunks.end() || !bytesOf(found->second, buffer, bytes))
+				return false;
+			out += bytes;
+		}
+		return true;
+	}
+
+	//скільки байтів фрагментів у пам'яті і скільки байтів текстів вони представляють
+	size_t getSizeInMemory() {
+		std::lock_guard<std::mutex> guard(lock);
+		return sizeInMemory;
+	}
+	size_t getSizeOfReferencedText() {
+		std::lock_guard<std::mutex> guard(lock);
+		return sizeOfReferencedText;
+	}
+};
+
+//історія команд сеансу одним неперервним журналом: короткі записи команд, описи їх змін і арена з байтами текстів змін.
+//Команди додаються і видаляються лише з кінця, тож арена звільняється простим скороченням, а не окремо для кожної команди.
+//Зміщення в арені логічні: коли арена перевищує бюджет, її початок (найдавніші команди) витісняється у файл з тими ж
+//зміщеннями, і тексти звідти читаються лише при глибокому скасуванні. Великі тексти змін натомість зберігаються в спільному
+//сховищі фрагментів, тож однаковий вміст у різних командах і сеансах займає пам'ять один раз
+class CommandsHistory {
+private:
+	struct CommandRecord {
+		CommandType type;
+		uint32_t firstDelta, countOfDeltas; //діапазон змін команди в deltas
+	};
+	struct DeltaRecord {
+		size_t position;
+		size_t offsetInArena; //де в арені лежить видалений текст; вставлений лежить одразу за ним
+		size_t lengthOfRemoved, lengthOfInserted;
+		uint32_t firstChunk, countOfChunks; //якщо countOfChunks > 0, текст лежить не в арені, а в сховищі фрагментів
+	};
+
+	static const size_t MAX_LENGTH_OF_COALESCED_EDIT = 32, //правки, не довші за це, зливаються з попередньою командою, як набір тексту
+		MAX_SIZE_OF_COALESCED_COMMAND = 4096, //і лише доки злита команда не перевищить цей розмір
+		MIN_SIZE_OF_CHUNKED_TEXT = 16 * 1024; //тексти змін, не коротші за це, зберігаються у сховищі фрагментів
+
+	std::vector<CommandRecord> commands;
+	std::vector<DeltaRecord> deltas;
+	std::string arena; //байти, починаючи з логічного зміщення baseOfArena
+	size_t baseOfArena; //скільки байтів з початку арени вже витіснено у файл
+	size_t memoryBudget; //скільки байтів арени може залишатись у пам'яті; 0 - без обмеження
+	std::string spillFilepath; //файл, куди витісняються найдавніші тексти змін
+	std::fstream spillFile; //відкривається лише при першому витісненні
+	ChunkStore* chunkStore; //спільне сховище великих текстів; nullptr - всі тексти в арені
+	std::vector<ChunkStore::ChunkId> chunkReferences; //фрагменти текстів змін по порядку команд
+
+	//вставлений текст лежить за видаленим, тож обидва читаються одним фрагментом; false, якщо текст не вдалося прочитати
+	//зі сховища фрагментів або з файлу витіснення (тоді зміну не можна ні повторити, ні скасувати)
+	bool textOf(const DeltaRecord& delta, std::string& buffer, std::string_view& text) {
+		size_t length = delta.lengthOfRemoved + delta.lengthOfInserted;
+		if (delta.countOfChunks > 0) {
+			buffer.clear();
+			if (!chunkStore->read(chunkReferences.data() + delta.firstChunk, delta.countOfChunks, buffer) || buffer.size() != length)
+				return false;
+			text = buffer;
+			return true;
+		}
+		if (delta.offsetInArena >= baseOfArena) {
+			text = std::string_view(arena).substr(delta.offsetInArena - baseOfArena, length);
+			return true;
+		}
+		if (!spillFile.is_open())
+			return false;
+
+		buffer.resize(length);
+		spillFile.clear();
+		if (!spillFile.seekg(delta.offsetInArena) || !spillFile.read(buffer.data(), length))
+			return false;
+		text = buffer;
+		return true;
+	}
+	//тексти всіх змін команди: читаються до того, як команда щось змінить, щоб нечитабельний запис не застосувався наполовину
+	bool textsOfCommand(int index, std::vector<std::string>& texts) {
+		std::string buffer;
+		std::string_view text;
+		for (uint32_t i = 0; i < commands[index].countOfDeltas; i++) {
+			if (!textOf(deltas[commands[index].firstDelta + i], buffer, text))
+				return false;
+			texts.emplace_back(text);
+		}
+		return true;
+	}
+	size_t offsetOfCommand(int index) const {
+		return commands[index].countOfDeltas > 0 ? deltas[commands[index].firstDelta].offsetInArena : endOfArena();
+	}
+	size_t endOfArena() const { return baseOfArena + arena.size(); }
+
+	//витісняє найдавніші команди, поки арена не займе половину бюджету; остання команда лишається в пам'яті, бо з нею зливаються правки
+	void spillIfOverBudget() {
+		if (memoryBudget == 0 || spillFilepath.empty() || arena.size() <= memoryBudget || commands.size() < 2)
+			return;
+
+		size_t target = endOfArena() - memoryBudget / 2, endOfSpill = baseOfArena;
+		for (int i = 0; i < (int)commands.size() - 1 && endOfSpill < target; i++)
+			endOfSpill = offsetOfCommand(i + 1);
+		if (endOfSpill <= baseOfArena)
+			return;
+
+		if (!spillFile.is_open()) {
+			std::filesystem::path parent = std::filesystem::path(spillFilepath).parent_path();
+			if (!parent.empty() && !std::filesystem::exists(parent))
+				std::filesystem::create_directories(parent);
+			spillFile.open(spillFilepath, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+			if (!spillFile.is_open())
+				return;
+		}
+
+		spillFile.seekp(baseOfArena);
+		spillFile.write(arena.data(), endOfSpill - baseOfArena);
+		spillFile.flush();
+		if (!spillFile) {
+			spillFile.clear();
+			return;
+		}
+
+		arena.erase(0, endOfSpill - baseOfArena);
+		baseOfArena = endOfSpill;
+	}
+
+public:
+	CommandsHistory() : baseOfArena(0), memoryBudget(0), chunkStore(nullptr) {}
+	~CommandsHistory() { clear(); }
+
+	void setSpillFile(std::string filepath, size_t memoryBudget) {
+		spillFilepath = filepath;
+		this->memoryBudget = memoryBudget;
+	}
+	void setChunkStore(ChunkStore* chunkStore) { this->chunkStore = chunkStore; }
+
+	void append(CommandType type, const TextDelta* deltasOfCommand, size_t countOfDeltas) {
+		TraceScope trace("CommandsHistory::append");
+		commands.push_back({ type, (uint32_t)deltas.size(), (uint32_t)countOfDeltas });
+		for (size_t i = 0; i < countOfDeltas; i++) {
+			const TextDelta& delta = deltasOfCommand[i];
+			DeltaRecord record{ delta.position, endOfArena(), delta.removedText.size(), delta.insertedText.size(), (uint32_t)chunkReferences.size(), 0 };
+
+			if (chunkStore && record.lengthOfRemoved + record.lengthOfInserted >= MIN_SIZE_OF_CHUNKED_TEXT) {
+				chunkStore->put(delta.removedText + delta.insertedText, chunkReferences);
+				record.countOfChunks = chunkReferences.size() - record.firstChunk;
+			}
+			else {
+				arena += delta.removedText;
+				arena += delta.insertedText;
+			}
+			deltas.push_back(record);
+		}
+		spillIfOverBudget();
+	}
+	void deleteLast() {
+		if (commands.back().countOfDeltas > 0) {
+			size_t firstChunk = deltas[commands.back().firstDelta].firstChunk;
+			if (chunkReferences.size() > firstChunk) {
+				chunkStore->release(chunkReferences.data() + firstChunk, chunkReferences.size() - firstChunk);
+				chunkReferences.resize(firstChunk);
+			}
+		}
+
+		size_t offset = offsetOfCommand(commands.size() - 1);
+		if (offset >= baseOfArena)
+			arena.resize(offset - baseOfArena);
+		else {
+			//решта файлу просто буде перезаписана при наступному витісненні
+			arena.clear();
+			baseOfArena = offset;
+		}
+		deltas.resize(commands.back().firstDelta);
+		commands.pop_back();
+	}
+	//звільняє і пам'ять, а не лише очищує вміст
+	void clear() {
+		if (!chunkReferences.empty())
+			chunkStore->release(chunkReferences.data(), chunkReferences.size());
+		std::vector<ChunkStore::ChunkId>().swap(chunkReferences);
+		std::vector<CommandRecord>().swap(commands);
+		std::vector<DeltaRecord>().swap(deltas);
+		std::string().swap(arena);
+		baseOfArena = 0;
+
+		if (spillFile.is_open()) {
+			spillFile.close();
+			remove(spillFilepath.c_str());
+		}
+	}
+
+	//чи зливається правка з останньою командою: обидві - вставки або обидві - видалення з однією зміною,
+	//нова правка коротка і торкається тексту, який остання команда вставила, або прилягає до нього
+	bool canCoalesce(CommandType type, const TextDelta& delta) const {
+		if (commands.empty() || (type != CommandType::Paste && type != CommandType::Delete))
+			return false;
+
+		const CommandRecord& last = commands.back();
+		if (last.type != type || last.countOfDeltas != 1)
+			return false;
+
+		const DeltaRecord& previous = deltas[last.firstDelta];
+		size_t endOfEdit = delta.position + delta.removedText.size();
+		return delta.removedText.size() + delta.insertedText.size() <= MAX_LENGTH_OF_COALESCED_EDIT &&
+			previous.lengthOfRemoved + previous.lengthOfInserted + delta.removedText.size() + delta.insertedText.size() <= MAX_SIZE_OF_COALESCED_COMMAND &&
+			delta.position <= previous.position + previous.lengthOfInserted && endOfEdit >= previous.position;
+	}
+	//зводить дві послідовні зміни до однієї: видалене новою правкою поза вставленим попередньою потрапляє до видаленого,
+	//а вставлене нею замінює відповідну частину вставленого попередньою
+	//false (історія не змінюється), якщо текст останньої команди не вдалося прочитати
+	bool coalesce(const TextDelta& delta) {
+		std::string buffer;
+		std::string_view text;
+		const DeltaRecord& record = deltas[commands.back().firstDelta];
+		if (!textOf(record, buffer, text))
+			return false;
+		TextDelta previous{ record.position, std::string(text.substr(0, record.lengthOfRemoved)), std::string(text.substr(record.lengthOfRemoved)) };
+		CommandType type = commands.back().type;
+
+		size_t start = previous.position, end = previous.position + previous.insertedText.size();
+		size_t startOfEdit = delta.position, endOfEdit = delta.position + delta.removedText.size();
+		size_t removedBefore = startOfEdit < start ? start - startOfEdit : 0, removedAfter = endOfEdit > end ? endOfEdit - end : 0;
+
+		TextDelta merged;
+		merged.position = std::min(start, startOfEdit);
+		merged.removedText = delta.removedText.substr(0, removedBefore) + previous.removedText +
+			delta.removedText.substr(delta.removedText.size() - removedAfter);
+		merged.insertedText = previous.insertedText.substr(0, startOfEdit > start ? startOfEdit - start : 0) + delta.insertedText +
+			previous.insertedText.substr(std::min(previous.insertedText.size(), endOfEdit > start ? endOfEdit - start : 0));
+
+		deleteLast();
+		append(type, &merged, 1);
+		return true;
+	}
+
+	int size() const { return commands.size(); }
+	//обсяг текстів змін, що залишаються в пам'яті (без спільних фрагментів, які мають власний бюджет)
+	size_t sizeInBytes() const { return arena.size(); }
+	//вся пам'ять історії: арена разом із записами команд, змін і посилань на фрагменти
+	size_t sizeInMemory() const {
+		return arena.size() + commands.size() * sizeof(CommandRecord) + deltas.size() * sizeof(DeltaRecord) +
+			chunkReferences.size() * sizeof(ChunkStore::ChunkId);
+	}
+	CommandType getTypeByIndex(int index) const { return commands[index].type; }
+	bool getDeltasByIndex(int index, std::vector<TextDelta>& result) {
+		std::vector<std::string> texts;
+		if (!textsOfCommand(index, texts))
+			return false;
+		for (uint32_t i = 0; i < commands[index].countOfDeltas; i++) {
+			const DeltaRecord& delta = deltas[commands[index].firstDelta + i];
+			result.push_back({ delta.position, texts[i].substr(0, delta.lengthOfRemoved), texts[i].substr(delta.lengthOfRemoved) });
+		}
+		return true;
+	}
 
-class Command;
+	//зміни застосовуються з кінця до початку, щоб позиції ще не застосованих замін залишались дійсними, а скасовуються з початку.
+	//Команду, тексти якої не вдалося прочитати, не можна ні повторити, ні скасувати: текст тоді не змінюється
+	bool redo(int index, TextBuffer* text) {
+		std::vector<std::string> texts;
+		if (!textsOfCommand(index, texts))
+			return false;
+		for (uint32_t i = commands[index].countOfDeltas; i > 0; i--) {
+			const DeltaRecord& delta = deltas[commands[index].firstDelta + i - 1];
+			text->replace(delta.position, delta.lengthOfRemoved, std::string_view(texts[i - 1]).substr(delta.lengthOfRemoved));
+		}
+		return true;
+	}
+	bool undo(int index, TextBuffer* text) {
+		std::vector<std::string> texts;
+		if (!textsOfCommand(index, texts))
+			return false;
+		for (uint32_t i = 0; i < commands[index].countOfDeltas; i++) {
+			const DeltaRecord& delta = deltas[commands[index].firstDelta + i];
+			text->replace(delta.position, delta.lengthOfInserted, std::string_view(texts[i]).substr(0, delta.lengthOfRemoved));
+		}
+		return true;
+	}
+};
 
 class Session {
 private:
-	std::stack<Command*> commandsHistory; //історія команд
-	std::stack<std::string> clipboard; //буфер обміну
+	CommandsHistory commandsHistory; //історія команд
+	Clipboard clipboard; //буфер обміну
 	int currentCommandIndexInHistory; //індекс на команді, на якій знаходиться користувач, бо, можливо, він скасував декілька команд або повторив,
 	//і це потрібно відслідковвувати
 	std::string name; //ім'я сеансу
+	CommandsJournal* journal; //журнал, в який дописується кожна виконана команда
+	bool isHistoryLoaded; //чи завантажена історія команд у пам'ять (інакше вона є лише в журналі)
+	int countOfUnloadedCommands; //кількість команд в історії, поки вона не завантажена
+	unsigned long long lastUse; //коли сеанс востаннє відкривали, щоб першими вивантажувати найдавніші
+	static unsigned long long counterOfUses;
+	unsigned long long generation, persistedGeneration; //лічильник змін сеансу і його значення на момент останнього запису на диск
 
 public:
-	Session() { currentCommandIndexInHistory = -1; }
+	Session() {
+		currentCommandIndexInHistory = -1;
+		journal = nullptr;
+		isHistoryLoaded = true;
+		countOfUnloadedCommands = 0;
+		lastUse = 0;
+		generation = 1; //новий сеанс ще не записаний
+		persistedGeneration = 0;
+	}
 	Session(std::string filename) : Session() { name = filename; }
-	~Session() {
-		while (!commandsHistory.empty()) {
-			if (commandsHistory.top())
-				delete commandsHistory.top();
-			commandsHistory.pop();
-		}
+	~Session() { delete journal; }
+
+	void addCommandAsLast(CommandType type, const TextDelta* deltas, size_t countOfDeltas = 1) { commandsHistory.append(type, deltas, countOfDeltas); }
+	void addDataToClipboard(const TextBuffer* text, size_t position, size_t count) { clipboard.add(text, position, count); }
+	void deleteLastCommand() { commandsHistory.deleteLast(); }
+	void unloadHistory() {
+		int countOfCommands = sizeOfCommandsHistory();
+		commandsHistory.clear();
+		setUnloadedHistory(countOfCommands, currentCommandIndexInHistory);
 	}
 
-	void addCommandAsLast(Command* command) { commandsHistory.push(command); }
-	void addDataToClipboard(std::string data) { clipboard.push(data); }
-	void deleteLastCommand() {
-		delete commandsHistory.top();
-		commandsHistory.pop();
-	}
+	void markChanged() { generation++; }
+	void markPersisted() { persistedGeneration = generation; }
+	bool isChangedSincePersisted() const { return generation != persistedGeneration; }
 
-	int sizeOfCommandsHistory() { return commandsHistory.size(); }
+	int sizeOfCommandsHistory() { return isHistoryLoaded ? commandsHistory.size() : countOfUnloadedCommands; }
 	int sizeOfClipboard() { return clipboard.size(); }
 
 	bool setName(std::string filename) {
@@ -50,124 +2875,292 @@ public:
 		this->currentCommandIndexInHistory = currentCommandIndexInHistory;
 	}
 
+	void setJournal(CommandsJournal* journal) { this->journal = journal; }
+	//історія ще в журналі: відомі лише кількість команд і поточний індекс з індексу сеансів
+	void setUnloadedHistory(int countOfCommands, int currentCommandIndexInHistory) {
+		isHistoryLoaded = false;
+		countOfUnloadedCommands = countOfCommands;
+		this->currentCommandIndexInHistory = currentCommandIndexInHistory;
+	}
+	void setHistoryAsLoaded() { isHistoryLoaded = true; }
+	void markAsUsed() { lastUse = ++counterOfUses; }
+
 	std::string getName() { return name; }
-	Command* getCommandByIndex(int index) { return commandsHistory._Get_container()[index]; }
+	CommandsJournal* getJournal() { return journal; }
+	bool getIsHistoryLoaded() { return isHistoryLoaded; }
+	//обсяг тексту змін в історії, за яким вирішується, чи вивантажувати сеанс
+	size_t getSizeOfHistoryInBytes() { return commandsHistory.sizeInBytes(); }
+	size_t getSizeOfHistoryInMemory() { return commandsHistory.sizeInMemory(); }
+	unsigned long long getLastUse() { return lastUse; }
+	CommandsHistory* getCommandsHistory() { return &commandsHistory; }
 	int getCurIndexInCommHistory() { return currentCommandIndexInHistory; }
-	std::string getDataFromClipboardByIndex(int index) { return clipboard._Get_container()[index]; }
-
-	void printClipboard() {
-		system("cls");
-		for (int i = 0; i < clipboard.size(); i++)
-			std::cout << "\n" << i + 1 << ") \"" << clipboard._Get_container()[i] << "\"";
-		std::cout << std::endl;
+	std::string getDataFromClipboardByIndex(int index) { return clipboard.getByIndex(index); }
+	Clipboard* getClipboard() { return &clipboard; }
+
+	//великі записи показуються лише початком, щоб не копіювати їх повністю
+	//encoding - кодування тексту сеансу, з якого скопійовані записи; UTF-8 перекодовується для консолі
+	void printClipboard(TextEncoding encoding) {
+		const size_t MAX_LENGTH_OF_PREVIEW = 200;
+
+		ConsoleRenderer::beginFrame();
+		for (int i = 0; i < clipboard.size(); i++) {
+			std::string preview = clipboard.getByIndex(i, MAX_LENGTH_OF_PREVIEW + 1);
+			if (encoding == TextEncoding::Utf8)
+				preview = Cp1251::fromUtf8(preview);
+			if (preview.size() > MAX_LENGTH_OF_PREVIEW)
+				std::cout << "\n" << i + 1 << ") \"" << preview.substr(0, MAX_LENGTH_OF_PREVIEW) << "...\"";
+			else
+				std::cout << "\n" << i + 1 << ") \"" << preview << "\"";
+		}
+		std::cout << "\n";
 	}
 };
 
-class SessionsHistory {
+template <typename Key, typename Value>
+class OrderedIndex {
 private:
-	std::stack<Session*> sessions; //історія сеансів
+	struct Node {
+		Key key;
+		Value value;
+		unsigned priority; //пріоритет вузла декартового дерева
+		int size; //кількість вузлів у піддереві, завдяки якій елемент можна знайти за порядковим номером
+		Node* left, * right;
+
+		Node(Key key, Value value, unsigned priority) : key(key), value(value), priority(priority), size(1), left(nullptr), right(nullptr) {}
+	};
+
+	Node* root;
+	unsigned seed; //стан генератора пріоритетів
+
+	unsigned nextPriority() {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		return seed;
+	}
+	static int sizeOf(Node* node) { return node ? node->size : 0; }
+	static void update(Node* node) { node->size = sizeOf(node->left) + 1 + sizeOf(node->right); }
+	static void destroy(Node* node) {
+		if (!node)
+			return;
+		destroy(node->left);
+		destroy(node->right);
+		delete node;
+	}
 
-public:
-	~SessionsHistory() {
-		while (!sessions.empty()) {
-			delete sessions.top();
-			sessions.pop();
+	Node* merge(Node* left, Node* right) {
+		if (!left || !right)
+			return left ? left : right;
+
+		if (left->priority > right->priority) {
+			left->right = merge(left->right, right);
+			update(left);
+			return left;
 		}
+		right->left = merge(left, right->left);
+		update(right);
+		return right;
 	}
+	//розділяє дерево на ключі, менші за key, і всі інші
+	void split(Node* node, const Key& key, Node*& left, Node*& right) {
+		if (!node) {
+			left = right = nullptr;
+			return;
+		}
 
-	void addSessionToEnd(Session* session) { sessions.push(session); }
-	Session* getSessionByIndex(int index) { return sessions._Get_container()[index]; }
-	Session* getSessionByName(std::string name) {
-		auto sessionsIter = std::find_if(sessions._Get_container().begin(), sessions._Get_container().end(), [name](Session* session) {
-			return session->getName() == name + ".txt" || session->getName() == name;
-			});
-
-		if (sessionsIter != sessions._Get_container().end())
-			return *sessionsIter;
-		else
-			return nullptr;
+		if (node->key < key) {
+			split(node->right, key, node->right, right);
+			left = node;
+		}
+		else {
+			split(node->left, key, left, node->left);
+			right = node;
+		}
+		update(node);
 	}
-	std::string deleteSessionByIndex(int index) {
-		auto ptrOnUnderlyingContainer = &sessions._Get_container();
-		auto ptrOnRetiringSession = (*ptrOnUnderlyingContainer)[index];
+	Node* eraseFrom(Node* node, const Key& key) {
+		if (!node)
+			return nullptr;
 
-		std::string filename = ptrOnRetiringSession->getName();
+		if (key < node->key)
+			node->left = eraseFrom(node->left, key);
+		else if (node->key < key)
+			node->right = eraseFrom(node->right, key);
+		else {
+			Node* rest = merge(node->left, node->right);
+			delete node;
+			return rest;
+		}
+		update(node);
+		return node;
+	}
+	bool visit(Node* node, int& rank, int fromRank, const std::function<bool(Value)>& action) {
+		if (!node)
+			return true;
 
-		std::deque<Session*> notRetiringElements;
+		if (rank + sizeOf(node->left) > fromRank) {
+			if (!visit(node->left, rank, fromRank, action))
+				return false;
+		}
+		else
+			rank += sizeOf(node->left);
 
-		remove_copy(ptrOnUnderlyingContainer->begin(),
-			ptrOnUnderlyingContainer->end(),
-			back_inserter(notRetiringElements),
-			ptrOnRetiringSession);
+		if (rank++ >= fromRank && !action(node->value))
+			return false;
 
-		sessions = std::stack<Session*>(notRetiringElements);
+		return visit(node->right, rank, fromRank, action);
+	}
 
-		delete ptrOnRetiringSession;
+public:
+	OrderedIndex() : root(nullptr), seed(2463534242u) {}
+	OrderedIndex(const OrderedIndex&) = delete;
+	OrderedIndex& operator=(const OrderedIndex&) = delete;
+	~OrderedIndex() { destroy(root); }
+
+	void insert(const Key& key, Value value) {
+		Node* left, * right;
+		split(root, key, left, right);
+		root = merge(merge(left, new Node(key, value, nextPriority())), right);
+	}
+	void erase(const Key& key) { root = eraseFrom(root, key); }
+
+	int size() { return sizeOf(root); }
+	//кількість ключів, менших за key, тобто позиція, з якої key стояв би в упорядкованому списку
+	int rankOf(const Key& key) {
+		int rank = 0;
+		for (Node* node = root; node;) {
+			if (node->key < key) {
+				rank += sizeOf(node->left) + 1;
+				node = node->right;
+			}
+			else
+				node = node->left;
+		}
+		return rank;
+	}
+	Value getByRank(int rank) {
+		Node* node = root;
+		while (node) {
+			if (rank < sizeOf(node->left))
+				node = node->left;
+			else if (rank == sizeOf(node->left))
+				return node->value;
+			else {
+				rank -= sizeOf(node->left) + 1;
+				node = node->right;
+			}
+		}
+		return Value();
+	}
+	//обходить значення по порядку ключів, починаючи з позиції fromRank, поки action повертає true
+	void forEach(int fromRank, const std::function<bool(Value)>& action) {
+		int rank = 0;
+		visit(root, rank, fromRank, action);
+	}
+};
 
-		return filename;
+class SessionsHistory {
+private:
+	std::unordered_map<std::string, Session*> sessionsByName; //сеанси за повним іменем файлу
+	OrderedIndex<std::string, Session*> sessionsSortedByName; //сеанси, впорядковані за іменем
+	OrderedIndex<unsigned long long, Session*> sessionsInAddingOrder; //сеанси в порядку додавання
+	std::unordered_map<Session*, unsigned long long> addingNumbers; //порядковий номер додавання кожного сеансу
+	unsigned long long counterOfAddedSessions;
+	bool isSortedByName; //чи нумеруються сеанси за іменем, а не за порядком додавання
+	unsigned long long generation, persistedGeneration; //лічильник додавань і видалень сеансів і його значення на момент запису на диск
+
+	Session* findSessionByFilename(const std::string& filename) {
+		auto iterator = sessionsByName.find(filename);
+		return iterator != sessionsByName.end() ? iterator->second : nullptr;
 	}
-	std::string deleteSessionByName(std::string name) {
-		auto sessionToDelete = getSessionByName(name);
-		if (!sessionToDelete)
-			return "";
 
-		Session* topSession;
-		std::string filename = sessionToDelete->getName();
-		std::stack<Session*> tempStack;
+public:
+	SessionsHistory() : counterOfAddedSessions(0), isSortedByName(false), generation(0), persistedGeneration(0) {}
+	~SessionsHistory() {
+		for (auto& entry : sessionsByName)
+			delete entry.second;
+	}
 
+	void addSessionToEnd(Session* session) {
+		sessionsByName[session->getName()] = session;
+		sessionsSortedByName.insert(session->getName(), session);
+		addingNumbers[session] = counterOfAddedSessions;
+		sessionsInAddingOrder.insert(counterOfAddedSessions++, session);
+		generation++;
+	}
+	Session* getSessionByIndex(int index) {
+		return isSortedByName ? sessionsSortedByName.getByRank(index) : sessionsInAddingOrder.getByRank(index);
+	}
+	//ім'я можна вводити як з розширенням файлу, так і без нього
+	Session* getSessionByName(std::string name) {
+		Session* session = findSessionByFilename(name + ".txt");
+		return session ? session : findSessionByFilename(name);
+	}
+	std::vector<Session*> getSessionsByPrefix(std::string prefix) {
+		std::vector<Session*> sessions;
 
-		while (!sessions.empty()) {
-			topSession = sessions.top();
-			sessions.pop();
+		sessionsSortedByName.forEach(sessionsSortedByName.rankOf(prefix), [&sessions, &prefix](Session* session) {
+			if (session->getName().compare(0, prefix.size(), prefix) != 0)
+				return false;
+			sessions.push_back(session);
+			return true;
+			});
 
-			if (topSession->getName() == name || topSession->getName() == name + ".txt") {
-				delete topSession;
-				continue;
-			}
+		return sessions;
+	}
+	std::string deleteSessionByIndex(int index) {
+		Session* session = getSessionByIndex(index);
+		return session ? deleteSession(session) : "";
+	}
+	std::string deleteSessionByName(std::string name) {
+		Session* session = getSessionByName(name);
+		return session ? deleteSession(session) : "";
+	}
+	std::string deleteSession(Session* session) {
+		std::string filename = session->getName();
 
-			tempStack.push(topSession);
-		}
+		sessionsByName.erase(filename);
+		sessionsSortedByName.erase(filename);
+		sessionsInAddingOrder.erase(addingNumbers[session]);
+		addingNumbers.erase(session);
+		generation++;
 
-		while (!tempStack.empty()) {
-			sessions.push(tempStack.top());
-			tempStack.pop();
-		}
+		delete session;
 
 		return filename;
 	}
 
-	bool isEmpty() { return sessions.size() == 0; }
-	int size() { return sessions.size(); }
-
-	void printSessionsHistory() {
-		system("cls");
-		for (int i = 0; i < sessions.size(); i++)
-			std::cout << "\nСеанс #" << i + 1 << ": " << sessions._Get_container()[i]->getName();
-		std::cout << std::endl;
-	}
-
-	void sortByName() {
-		std::deque<Session*> tempSessions;
+	void markPersisted() { persistedGeneration = generation; }
+	bool isChangedSincePersisted() const { return generation != persistedGeneration; }
 
-		while (!sessions.empty()) {
-			tempSessions.push_back(sessions.top());
-			sessions.pop();
-		}
+	bool isEmpty() { return sessionsByName.empty(); }
+	int size() { return sessionsByName.size(); }
 
-		std::sort(tempSessions.begin(), tempSessions.end(), [](Session* a, Session* b) {
-			return a->getName() < b->getName();
-			});
+	void printSessionsHistory() {
+		ConsoleRenderer::beginFrame();
+		int number = 0;
+		auto printSession = [&number](Session* session) {
+			std::cout << "\nСеанс #" << ++number << ": " << session->getName();
+			return true;
+		};
 
-		for (Session* session : tempSessions)
-			sessions.push(session);
+		if (isSortedByName)
+			sessionsSortedByName.forEach(0, printSession);
+		else
+			sessionsInAddingOrder.forEach(0, printSession);
+		std::cout << "\n";
 	}
+
+	//упорядкований за іменем індекс підтримується завжди, тому сортування лише перемикає нумерацію
+	void sortByName() { isSortedByName = true; }
+	bool getIsSortedByName() { return isSortedByName; }
 };
 
 class Editor {
 private:
 	static SessionsHistory* sessionsHistory; //історія сеансів
 	static Session* currentSession; //сеанс, з яким користувач працює в даний момент
-	static std::string* currentText; //текст, який користувач редагує в даний момент
+	static TextBuffer* currentText; //текст, який користувач редагує в даний момент
 
 public:
 	Editor();
@@ -181,128 +3174,364 @@ public:
 	void tryToLoadSessions();
 	void tryToUnloadSessions();
 
-	void copy(std::string textToProcess, int startPosition, int endPosition);
-	void paste(std::string* textToProcess, int startPosition, int endPosition, std::string textToPaste);
-	void cut(std::string* textToProcess, int startPosition, int endPosition);
-	void remove(std::string* textToProcess, int startPosition, int endPosition);
+	void copy(TextBuffer* textToProcess, int startPosition, int endPosition);
+	TextDelta paste(TextBuffer* textToProcess, int startPosition, int endPosition, std::string textToPaste);
+	TextDelta insert(TextBuffer* textToProcess, size_t position, std::string textToInsert);
+	TextDelta cut(TextBuffer* textToProcess, int startPosition, int endPosition);
+	TextDelta remove(TextBuffer* textToProcess, int startPosition, int endPosition);
+	std::vector<TextDelta> findReplacements(TextBuffer* textToProcess, const std::vector<std::pair<std::string, std::string>>& replacements);
 
 	static Session* getCurrentSession();
 	static SessionsHistory* getSessionsHistory();
-	static std::string* getCurrentText();
+	static TextBuffer* getCurrentText();
 	static void setCurrentSession(Session* session);
-	static void setCurrentText(std::string* text);
+	static void setCurrentText(TextBuffer* text);
 
 	static void printCurrentText();
+	static void printPageOfCurrentText(size_t firstLine, size_t countOfLinesOnPage);
 };
 
-class Command {
-protected:
-	Editor* editor; //редактор, в якому відбувається редагування тексту за допомогою команд
-	int startPosition, endPosition; //початкова та кінцева позиції для вставки, заміни, видалення, копіювання, вирізання
-	std::string textToProcess, textToPaste; //поля для тексту, який обробляємо і для тексту, який вставляємо 
-	Command* previousCommand, * commandToUndoOrRedo; //вказівник на попередню команду (в історії команд щось по типу однонапрямленого списка),
-	//далі - вказівник на команду, яку збираємось скасувати або повторити
+//гістограма тривалостей з логарифмічними кошиками, як у HDR Histogram: у кожному діапазоні [2^k, 2^(k+1)) по 16 кошиків,
+//тож будь-який перцентиль визначається з похибкою до 1/16 за сталої пам'яті. Запис - одне атомарне збільшення лічильника
+class LatencyHistogram {
+private:
+	static const unsigned SUB_BUCKET_BITS = 4;
+	static const size_t COUNT_OF_SUB_BUCKETS = 1 << SUB_BUCKET_BITS,
+		COUNT_OF_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * COUNT_OF_SUB_BUCKETS;
+
+	std::atomic<uint64_t> buckets[COUNT_OF_BUCKETS];
+	std::atomic<uint64_t> count, sum, max;
+
+	static size_t indexOf(uint64_t value) {
+		if (value < COUNT_OF_SUB_BUCKETS)
+			return (size_t)value;
+		unsigned shift = std::bit_width(value) - 1 - SUB_BUCKET_BITS;
+		return (shift + 1) * COUNT_OF_SUB_BUCKETS + (size_t)((value >> shift) - COUNT_OF_SUB_BUCKETS);
+	}
+	//найбільше значення, що потрапляє в кошик
+	static uint64_t highestValueOf(size_t index) {
+		if (index < COUNT_OF_SUB_BUCKETS)
+			return index;
+		unsigned shift = (unsigned)(index / COUNT_OF_SUB_BUCKETS - 1);
+		return ((index % COUNT_OF_SUB_BUCKETS + COUNT_OF_SUB_BUCKETS + 1) << shift) - 1;
+	}
 
 public:
-	virtual void execute() = 0;
-	virtual void undo() = 0;
-	virtual Command* copy() = 0;
+	LatencyHistogram() : count(0), sum(0), max(0) {
+		for (std::atomic<uint64_t>& bucket : buckets)
+			bucket.store(0, std::memory_order_relaxed);
+	}
 
-	void setParameters(std::string typeOfCommand, Command* previousCommand, Command* commandToUndoOrRedo, int startPosition, int endPosition, std::string textToPaste) {
-		if (typeOfCommand == "Undo" || typeOfCommand == "Redo")
-		{
-			this->commandToUndoOrRedo = commandToUndoOrRedo;
-			return;
+	void record(uint64_t nanoseconds) {
+		buckets[indexOf(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+		count.fetch_add(1, std::memory_order_relaxed);
+		sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+		for (uint64_t previous = max.load(std::memory_order_relaxed); previous < nanoseconds &&
+			!max.compare_exchange_weak(previous, nanoseconds, std::memory_order_relaxed);) {}
+	}
+
+	uint64_t getCount() const { return count.load(std::memory_order_relaxed); }
+	uint64_t getMax() const { return max.load(std::memory_order_relaxed); }
+	uint64_t getMean() const {
+		uint64_t countOfValues = getCount();
+		return countOfValues ? sum.load(std::memory_order_relaxed) / countOfValues : 0;
+	}
+	//percentile - від 0 до 100; повертається верхня межа кошика, але не більше за максимум
+	uint64_t getPercentile(double percentile) const {
+		uint64_t countOfValues = getCount(), seen = 0;
+		if (countOfValues == 0)
+			return 0;
+
+		uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(percentile / 100 * countOfValues));
+		for (size_t i = 0; i < COUNT_OF_BUCKETS; i++) {
+			seen += buckets[i].load(std::memory_order_relaxed);
+			if (seen >= rank)
+				return std::min(highestValueOf(i), getMax());
 		}
+		return getMax();
+	}
+};
 
-		if (startPosition > endPosition && endPosition > -1 && startPosition < Editor::getCurrentText()->size())
-			std::swap(startPosition, endPosition);
+enum class MeasuredOperation : unsigned char {
+	//перші сім - команди, в тому ж порядку, що й CommandType
+	CopyCommand, PasteCommand, CutCommand, DeleteCommand, ReplaceAllCommand, UndoCommand, RedoCommand,
+	EditorPaste, EditorInsert, EditorCut, EditorRemove,
+	LoadSessions, SaveSessions, LoadSessionHistory, ReadSessionText, WriteSessionData,
+	Count
+};
 
-		if (startPosition == -1 && endPosition == -1) {
-			startPosition = 0;
-			endPosition = 0;
-		}
+//тривалості операцій і облік пам'яті сеансів. Гістограми пишуться з будь-якого потоку; облік сеансів оновлює головний потік,
+//а читає і він (меню статистики), і потік, що періодично записує звіт у файл
+class Metrics {
+public:
+	struct SessionMemory {
+		size_t textBytes, historyBytes, clipboardBytes;
+	};
+
+private:
+	static LatencyHistogram histograms[(size_t)MeasuredOperation::Count];
+	static std::mutex lockOfSessions;
+	static std::map<std::string, SessionMemory> memoryOfSessions;
 
-		this->startPosition = startPosition;
-		this->endPosition = endPosition;
-		this->textToProcess = *(Editor::getCurrentText());
-		this->previousCommand = previousCommand;
+public:
+	static const char* nameOf(MeasuredOperation operation) {
+		static const char* names[] = { "command.copy", "command.paste", "command.cut", "command.delete", "command.replace_all",
+			"command.undo", "command.redo", "editor.paste", "editor.insert", "editor.cut", "editor.remove", "files.load_sessions",
+			"files.save_sessions", "files.load_session_history", "files.read_session_text", "files.write_session_data" };
+		return names[(size_t)operation];
+	}
+	static LatencyHistogram& of(MeasuredOperation operation) { return histograms[(size_t)operation]; }
 
-		if (typeOfCommand == "Paste")
-			this->textToPaste = textToPaste;
+	//text - текст сеансу, якщо він зараз у пам'яті; тексти решти сеансів не завантажені
+	static void accountSession(Session* session, const TextBuffer* text) {
+		SessionMemory memory = { text ? text->sizeInMemory() : 0, session->getSizeOfHistoryInMemory(), session->getClipboard()->getSizeInMemory() };
+		std::lock_guard<std::mutex> guard(lockOfSessions);
+		memoryOfSessions[session->getName()] = memory;
+	}
+	//повністю перераховує облік: після відкриття сеансу, коли давно не відкривані сеанси могли бути вивантажені
+	static void accountSessions(SessionsHistory* sessionsHistory, Session* currentSession, const TextBuffer* currentText) {
+		std::map<std::string, SessionMemory> memory;
+		for (int i = 0; i < sessionsHistory->size(); i++) {
+			Session* session = sessionsHistory->getSessionByIndex(i);
+			memory[session->getName()] = { session == currentSession && currentText ? currentText->sizeInMemory() : 0,
+				session->getSizeOfHistoryInMemory(), session->getClipboard()->getSizeInMemory() };
+		}
+		std::lock_guard<std::mutex> guard(lockOfSessions);
+		memoryOfSessions = std::move(memory);
 	}
+	static void forgetSession(const std::string& name) {
+		std::lock_guard<std::mutex> guard(lockOfSessions);
+		memoryOfSessions.erase(name);
+	}
+	static std::map<std::string, SessionMemory> getMemoryOfSessions() {
+		std::lock_guard<std::mutex> guard(lockOfSessions);
+		return memoryOfSessions;
+	}
+
+	//звіт у форматі JSON: тривалості в наносекундах, пам'ять у байтах
+	static std::string toJson(size_t sizeOfSharedHistory) {
+		std::string json = "{\n  \"timestamp_ms\": " + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count()) + ",\n  \"latency_ns\": {";
+
+		for (size_t i = 0; i < (size_t)MeasuredOperation::Count; i++) {
+			const LatencyHistogram& histogram = histograms[i];
+			json += std::string(i ? "," : "") + "\n    \"" + nameOf((MeasuredOperation)i) + "\": {\"count\": " + std::to_string(histogram.getCount()) +
+				", \"mean\": " + std::to_string(histogram.getMean()) + ", \"p50\": " + std::to_string(histogram.getPercentile(50)) +
+				", \"p90\": " + std::to_string(histogram.getPercentile(90)) + ", \"p99\": " + std::to_string(histogram.getPercentile(99)) +
+				", \"max\": " + std::to_string(histogram.getMax()) + "}";
+		}
 
-	std::string getTextToProcess() { return textToProcess; }
-	void setTextToProcess(std::string textToProcess) { this->textToProcess = textToProcess; }
-	void setPreviousCommand(Command* previousCommand) { this->previousCommand = previousCommand; }
+		json += "\n  },\n  \"shared_history_bytes\": " + std::to_string(sizeOfSharedHistory) + ",\n  \"sessions\": {";
+		bool isFirst = true;
+		for (const auto& [name, memory] : getMemoryOfSessions()) {
+			json += std::string(isFirst ? "" : ",") + "\n    \"" + name + "\": {\"text_bytes\": " + std::to_string(memory.textBytes) +
+				", \"history_bytes\": " + std::to_string(memory.historyBytes) + ", \"clipboard_bytes\": " + std::to_string(memory.clipboardBytes) + "}";
+			isFirst = false;
+		}
+		json += "\n  }\n}\n";
+		return json;
+	}
 };
 
-class CopyCommand : public Command {
+LatencyHistogram Metrics::histograms[(size_t)MeasuredOperation::Count];
+std::mutex Metrics::lockOfSessions;
+std::map<std::string, Metrics::SessionMemory> Metrics::memoryOfSessions;
+
+//вимірює час від створення до виходу з області видимості, а під час трасування ще й записує подію
+class ScopedLatency {
+private:
+	LatencyHistogram& histogram;
+	std::chrono::steady_clock::time_point start;
+	TraceScope trace;
+
 public:
-	CopyCommand(Editor* editor);
+	ScopedLatency(MeasuredOperation operation) : histogram(Metrics::of(operation)), start(std::chrono::steady_clock::now()), trace(Metrics::nameOf(operation)) {}
+	~ScopedLatency() {
+		histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+	}
+};
 
-	void execute() override;
-	void undo() override;
-	Command* copy() override;
+//розподіляє незалежні завдання між потоками за кількістю ядер: кожен потік бере наступний індекс зі спільного лічильника,
+//тож довгі завдання не затримують решту. Результати складаються в комірки за індексом, щоб їх порядок не залежав від потоків
+class WorkersPool {
+public:
+	static size_t countOfWorkers() {
+		unsigned countOfCores = std::thread::hardware_concurrency();
+		return countOfCores ? countOfCores : 1;
+	}
+	//виняток із завдання не виходить за межі потоку (це завершило б програму): решта завдань пропускається,
+	//а перший виняток передається викликачеві після завершення всіх потоків
+	static void forEachIndex(size_t count, const std::function<void(size_t)>& action) {
+		std::atomic<size_t> nextIndex(0);
+		std::exception_ptr firstError;
+		std::mutex lockOfError;
+		auto work = [&nextIndex, count, &action, &firstError, &lockOfError]() {
+			try {
+				for (size_t index = nextIndex++; index < count; index = nextIndex++)
+					action(index);
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> guard(lockOfError);
+				if (!firstError)
+					firstError = std::current_exception();
+				nextIndex = count;
+			}
+		};
+
+		std::vector<std::thread> workers;
+		for (size_t i = 1; i < std::min(countOfWorkers(), count); i++)
+			workers.emplace_back([&work]() {
+				Tracer::setThreadName("worker");
+				work();
+				});
+		work();
+		for (std::thread& worker : workers)
+			worker.join();
+		if (firstError)
+			std::rethrow_exception(firstError);
+	}
 };
 
-class DeleteCommand : public Command {
+//пошук у файлах усіх сеансів: файли відображаються в пам'ять і діляться на блоки, які потоки розбирають по одному, тож великий
+//файл шукається кількома потоками одночасно. Входження видаються в порядку файлів і зміщень, щойно готові всі блоки перед ними,
+//а пошук зупиняється, як тільки onMatch поверне false
+class SessionsSearcher {
 public:
-	DeleteCommand(Editor* editor);
+	struct Match {
+		std::string sessionName;
+		size_t line, column; //з 1, як при введенні позиції рядок:стовпець
+		size_t offset; //зміщення в байтах файлу
+	};
 
-	void execute() override;
-	void undo() override;
-	Command* copy() override;
-};
+private:
+	static const size_t SIZE_OF_BLOCK = 4 * 1024 * 1024;
+
+	struct Occurrence {
+		size_t offset, newlinesBefore; //скільки символів нового рядка в блоці передує входженню
+		size_t lastNewline; //зміщення останнього з них у файлі або npos
+	};
+	struct Block {
+		size_t indexOfFile, start, end;
+		std::vector<Occurrence> occurrences;
+		size_t countOfNewlines, lastNewline;
+		bool isDone;
+	};
+
+	//шукає входження, що починаються в блоці (тому захоплює ще pattern.size() - 1 байтів за ним), і рахує рядки до кожного
+	static void searchInBlock(const MappedFile& file, Block& block, const std::string& pattern, const std::atomic<bool>& isCancelled) {
+		const char* data = file.data();
+		size_t scanned = block.start, newlines = 0, lastNewline = std::string::npos;
+		auto countNewlinesUpTo = [data, &scanned, &newlines, &lastNewline](size_t position) {
+			for (size_t found = ByteScanner::find(data + scanned, position - scanned, '\n'); scanned + found < position;
+				found = ByteScanner::find(data + scanned, position - scanned, '\n')) {
+				lastNewline = scanned + found;
+				newlines++;
+				scanned = lastNewline + 1;
+			}
+			scanned = position;
+		};
+
+		size_t endOfSearch = std::min(file.size(), block.end + pattern.size() - 1);
+		TextSearcher::forEachOccurrence(data + block.start, endOfSearch - block.start, pattern, [&](size_t position) {
+			if (block.start + position >= block.end || isCancelled)
+				return false;
+			countNewlinesUpTo(block.start + position);
+			block.occurrences.push_back({ block.start + position, newlines, lastNewline });
+			return true;
+			});
+		countNewlinesUpTo(block.end);
+		block.countOfNewlines = newlines;
+		block.lastNewline = lastNewline;
+	}
 
-class CutCommand : public Command {
 public:
-	CutCommand(Editor* editor);
+	//filepaths - файли сеансів, імена сеансів беруться з імен файлів
+	static void search(const std::vector<std::string>& filepaths, const std::string& pattern, const std::function<bool(const Match&)>& onMatch) {
+		if (pattern.empty())
+			return;
 
-	void execute() override;
-	void undo() override;
-	Command* copy() override;
-};
+		std::vector<std::unique_ptr<MappedFile>> files;
+		std::vector<Block> blocks;
+		for (const std::string& filepath : filepaths) {
+			files.push_back(std::make_unique<MappedFile>());
+			if (!files.back()->open(filepath))
+				continue;
+			for (size_t start = 0; start < files.back()->size(); start += SIZE_OF_BLOCK)
+				blocks.push_back({ files.size() - 1, start, std::min(files.back()->size(), start + SIZE_OF_BLOCK), {}, 0, std::string::npos, false });
+		}
 
-class PasteCommand : public Command {
-public:
-	PasteCommand(Editor* editor);
+		std::atomic<bool> isCancelled(false);
+		std::mutex lockOfOutput;
+		size_t nextBlockToEmit = 0, newlinesBeforeBlock = 0, lastNewlineBeforeBlock = std::string::npos;
+
+		//видає всі готові блоки, що йдуть підряд від першого ще не виданого; номери рядків накопичуються в межах файлу
+		auto emitReadyBlocks = [&]() {
+			for (; nextBlockToEmit < blocks.size() && blocks[nextBlockToEmit].isDone && !isCancelled; nextBlockToEmit++) {
+				Block& block = blocks[nextBlockToEmit];
+				if (block.start == 0) {
+					newlinesBeforeBlock = 0;
+					lastNewlineBeforeBlock = std::string::npos;
+				}
 
-	void execute() override;
-	void undo() override;
-	Command* copy() override;
-};
+				std::string sessionName = std::filesystem::path(filepaths[block.indexOfFile]).filename().string();
+				for (const Occurrence& occurrence : block.occurrences) {
+					size_t lastNewline = occurrence.newlinesBefore > 0 ? occurrence.lastNewline : lastNewlineBeforeBlock;
+					size_t startOfLine = lastNewline == std::string::npos ? 0 : lastNewline + 1;
+					if (!onMatch({ sessionName, newlinesBeforeBlock + occurrence.newlinesBefore + 1, occurrence.offset - startOfLine + 1, occurrence.offset })) {
+						isCancelled = true;
+						break;
+					}
+				}
 
-class UndoCommand : public Command {
-public:
-	~UndoCommand() {
-		if (commandToUndoOrRedo)
-			delete (commandToUndoOrRedo);
-	}
+				newlinesBeforeBlock += block.countOfNewlines;
+				if (block.countOfNewlines > 0)
+					lastNewlineBeforeBlock = block.lastNewline;
+				std::vector<Occurrence>().swap(block.occurrences);
+			}
+		};
 
-	void execute() override;
-	void undo() override;
-	Command* copy() override;
-};
+		WorkersPool::forEachIndex(blocks.size(), [&](size_t i) {
+			if (isCancelled)
+				return;
+			{
+				TraceScope trace("SessionsSearcher::searchInBlock");
+				searchInBlock(*files[blocks[i].indexOfFile], blocks[i], pattern, isCancelled);
+			}
 
-class RedoCommand : public Command {
-public:
-	~RedoCommand() {
-		if (commandToUndoOrRedo)
-			delete (commandToUndoOrRedo);
+			std::lock_guard<std::mutex> guard(lockOfOutput);
+			blocks[i].isDone = true;
+			emitReadyBlocks();
+			});
 	}
-
-	void execute() override;
-	void undo() override;
-	Command* copy() override;
 };
 
 class FilesManager {
 private:
 	friend class Editor;
 
-	static const std::string METADATA_DIRECTORY, //директорія папки метаданих
-		DATA_DIRECTORY; //директорія, де безпосередньо збергаються текстові файли, які ми редагуємо в програмі
+	static const std::string METADATA_DIRECTORY, //директорія папки метаданих (історія старого формату, яка лише переноситься в журнали)
+		JOURNAL_DIRECTORY, //директорія журналів команд сеансів
+		SESSIONS_INDEX_FILEPATH, //індекс сеансів, завдяки якому при запуску не потрібно читати журнали
+		DATA_DIRECTORY, //директорія, де безпосередньо збергаються текстові файли, які ми редагуємо в програмі
+		CLIPBOARD_DIRECTORY, //директорія буферів обміну сеансів, збережених між запусками
+		HISTORY_SPILL_DIRECTORY, //директорія, куди на час роботи витісняються найдавніші тексти змін з історій сеансів
+		CHUNKS_FILEPATH, //файл, куди на час роботи витісняються давно не читані фрагменти великих текстів змін
+		MOVED_ORIGINALS_DIRECTORY, //директорія, куди при збереженні переносяться відображені великі файли, поки їх ще читають
+		METRICS_FILEPATH; //куди періодично записується звіт про тривалості операцій і пам'ять сеансів
+	static const bool IS_CLIPBOARD_PERSISTENT; //чи зберігати буфери обміну сеансів між запусками
+	static const std::chrono::milliseconds AUTOSAVE_COALESCING_WINDOW; //скільки чекати після правки, перш ніж фоново записати файл сеансу
+	static const std::chrono::milliseconds METRICS_REPORT_INTERVAL; //як часто оновлюється звіт метрик
+	static const size_t SESSION_HISTORY_MEMORY_BUDGET; //скільки байтів змін історія одного сеансу тримає в пам'яті, решта витісняється у файл
+	static const size_t HISTORY_MEMORY_BUDGET; //скільки байтів змін можуть займати завантажені історії, перш ніж давно не відкривані сеанси вивантажуються
+	static const size_t CHUNKS_MEMORY_BUDGET; //скільки байтів унікальних фрагментів сховище тримає в пам'яті
+	static const uint64_t LARGE_FILE_THRESHOLD; //файли від цього розміру не читаються в пам'ять, а редагуються поверх відображення
+	static ChunkStore historyChunks; //спільне для всіх сеансів сховище великих текстів змін
+
+	struct SessionIndexEntry {
+		int countOfCommands, currentCommandIndex;
+		uint64_t sizeOfJournal; //зміщення кінця журналу на момент запису індексу: якщо розмір файлу інший, запис застарів
+	};
+	static std::unordered_map<std::string, SessionIndexEntry> persistedIndex; //індекс у тому вигляді, в якому він зараз лежить на диску
 
 	static std::stack<std::string> getFilepathsForMetadata(std::string directory) {
 		std::stack<std::string> filesFromMetadataDirectory;
@@ -314,358 +3543,1179 @@ private:
 
 		return filesFromMetadataDirectory;
 	}
-	static std::string readDataByDelimiter(std::ifstream* ifs_session, std::string delimiter) {
-		std::string line, text;
-		int counterOfLines = 0;
+	//false, якщо файл закінчився раніше за закривальний роздільник (метадані обрізані)
+	static bool readDataByDelimiter(LineReader* reader, std::string delimiter, std::string& text, bool skipOpeningDelimiter = true) {
+		std::string_view line;
+		std::vector<std::string_view> lines;
+		size_t sizeOfText = 0;
+		bool isClosed = false;
+
+		if (skipOpeningDelimiter && !reader->nextLine(line))
+			return false;
+		while (reader->nextLine(line)) {
+			if (line == delimiter) {
+				isClosed = true;
+				break;
+			}
+			lines.push_back(line);
+			sizeOfText += line.size() + 1;
+		}
+
+		text.clear();
+		text.reserve(sizeOfText);
+		for (size_t i = 0; i < lines.size(); i++) {
+			if (i > 0)
+				text += '\n';
+			text.append(lines[i]);
+		}
+
+		return isClosed;
+	}
+	//число на весь рядок; на відміну від stoi не кидає винятків, тож придатне для розбору в потоках WorkersPool
+	template <typename Number>
+	static bool parseNumber(std::string_view line, Number& number) {
+		auto [end, error] = std::from_chars(line.data(), line.data() + line.size(), number);
+		return error == std::errc() && end == line.data() + line.size();
+	}
+
+	static CommandType getCommandTypeOfOpcode(JournalOpcode opcode) {
+		switch (opcode)
+		{
+		case JournalOpcode::Paste: return CommandType::Paste;
+		case JournalOpcode::Cut: return CommandType::Cut;
+		case JournalOpcode::ReplaceAll: return CommandType::ReplaceAll;
+		case JournalOpcode::Undo: return CommandType::Undo;
+		case JournalOpcode::Redo: return CommandType::Redo;
+		default: return CommandType::Delete;
+		}
+	}
+
+	static std::unordered_map<std::string, SessionIndexEntry> readSessionsIndex() {
+		std::unordered_map<std::string, SessionIndexEntry> index;
+		MappedFile file;
+
+		if (!file.open(SESSIONS_INDEX_FILEPATH) || file.size() < 4)
+			return index;
+
+		std::string_view content(file.data(), file.size() - 4);
+		if (BinaryFormat::readUint32(file.data() + content.size()) != BinaryFormat::crc32(content.data(), content.size()))
+			return index;
 
-		getline(*ifs_session, line);
-		while (getline(*ifs_session, line)) {
-			if (line == delimiter)
+		size_t offset = 0;
+		uint64_t countOfEntries, countOfCommands, currentIndex, sizeOfJournal;
+		std::string name;
+
+		if (!BinaryFormat::readVarint(content, offset, countOfEntries))
+			return index;
+
+		for (uint64_t i = 0; i < countOfEntries; i++) {
+			if (!BinaryFormat::readBytes(content, offset, name) ||
+				!BinaryFormat::readVarint(content, offset, countOfCommands) ||
+				!BinaryFormat::readVarint(content, offset, currentIndex) ||
+				!BinaryFormat::readVarint(content, offset, sizeOfJournal))
 				break;
-			counterOfLines++;
-			if (counterOfLines > 1)
-				line = "\n" + line;
-			text += line;
+			index[name] = { (int)countOfCommands, (int)currentIndex - 1, sizeOfJournal };
 		}
 
-		return text;
+		return index;
 	}
+	//індекс переписується, лише якщо змінився склад сеансів або хоч один сеанс; розмір журналу перечитується тільки для змінених
+	//сеансів, а записи решти беруться з уже збереженого індексу
+	static void writeSessionsIndex(SessionsHistory* sessionsHistory) {
+		TraceScope trace("FilesManager::writeSessionsIndex");
+		std::string content;
+		std::error_code error;
+		bool isIndexChanged = sessionsHistory->isChangedSincePersisted();
+
+		for (int i = 0; i < sessionsHistory->size(); i++) {
+			Session* session = sessionsHistory->getSessionByIndex(i);
+			if (!session->isChangedSincePersisted())
+				continue;
 
-	static void deleteMetadataForDeletedSessions(SessionsHistory* sessionsHistory, std::string directory) {
-		if (!std::filesystem::exists(directory))
+			uint64_t sizeOfJournal = std::filesystem::file_size(JOURNAL_DIRECTORY + session->getName(), error);
+			persistedIndex[session->getName()] = { session->sizeOfCommandsHistory(), session->getCurIndexInCommHistory(), error ? 0 : sizeOfJournal };
+			session->markPersisted();
+			isIndexChanged = true;
+		}
+		if (!isIndexChanged)
 			return;
 
-		std::stack<std::string> filesFromMetadataDirectory = getFilepathsForMetadata(directory);
-		std::string sessionFilepath;
-		bool isPartOfRealtimeSessions;
+		BinaryFormat::appendVarint(content, sessionsHistory->size());
+		for (int i = 0; i < sessionsHistory->size(); i++) {
+			std::string name = sessionsHistory->getSessionByIndex(i)->getName();
+			const SessionIndexEntry& entry = persistedIndex[name];
 
-		for (int i = 0; i < filesFromMetadataDirectory.size(); i++)
-		{
-			isPartOfRealtimeSessions = false;
-			for (int j = 0; j < sessionsHistory->size(); j++)
-			{
-				sessionFilepath = directory + sessionsHistory->getSessionByIndex(j)->getName();
-				if (filesFromMetadataDirectory._Get_container()[i] == sessionFilepath)
-					isPartOfRealtimeSessions = true;
-			}
+			BinaryFormat::appendVarint(content, name.size());
+			content += name;
+			BinaryFormat::appendVarint(content, entry.countOfCommands);
+			BinaryFormat::appendVarint(content, entry.currentCommandIndex + 1);
+			BinaryFormat::appendVarint(content, entry.sizeOfJournal);
+		}
+		BinaryFormat::appendUint32(content, BinaryFormat::crc32(content.data(), content.size()));
+
+		if (!std::filesystem::exists(JOURNAL_DIRECTORY))
+			std::filesystem::create_directories(JOURNAL_DIRECTORY);
+
+		//як і файл сеансу: індекс пишеться поруч і підміняє старий, тож збій під час запису не залишає обрізаного індексу
+		std::string temporaryFilepath = SESSIONS_INDEX_FILEPATH + ".tmp";
+		HANDLE file = CreateFileW(std::filesystem::path(temporaryFilepath).c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return;
 
-			if (!isPartOfRealtimeSessions)
-				remove(filesFromMetadataDirectory._Get_container()[i].c_str());
+		DWORD written;
+		bool isWritten = WriteFile(file, content.data(), (DWORD)content.size(), &written, nullptr) && written == content.size() && FlushFileBuffers(file);
+		CloseHandle(file);
+		if (!isWritten || !MoveFileExW(std::filesystem::path(temporaryFilepath).c_str(), std::filesystem::path(SESSIONS_INDEX_FILEPATH).c_str(),
+			MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+			remove(temporaryFilepath.c_str());
+			return;
 		}
-		
+		sessionsHistory->markPersisted();
+	}
+	//файли буферів обміну, журнали і записи індексу, яким не відповідає жоден сеанс, шукаються різницею множин імен;
+	//якщо в індексі таких записів немає, він уже відповідає завантаженим сеансам
+	static void removeOrphanedFiles(SessionsHistory* sessionsHistory) {
+		std::unordered_set<std::string> names;
+		std::error_code error;
+
+		for (int i = 0; i < sessionsHistory->size(); i++)
+			names.insert(sessionsHistory->getSessionByIndex(i)->getName());
+
+		if (std::filesystem::exists(CLIPBOARD_DIRECTORY, error))
+			for (const auto& entry : std::filesystem::directory_iterator(CLIPBOARD_DIRECTORY, error))
+				if (!names.count(entry.path().filename().string()))
+					std::filesystem::remove(entry.path(), error);
+
+		//сам індекс і тимчасові файли незавершених записів журналами сеансів не є
+		if (std::filesystem::exists(JOURNAL_DIRECTORY, error))
+			for (const auto& entry : std::filesystem::directory_iterator(JOURNAL_DIRECTORY, error))
+				if (entry.path().extension() != ".index" && entry.path().extension() != ".tmp" && !names.count(entry.path().filename().string()))
+					std::filesystem::remove(entry.path(), error);
+
+		size_t countOfOrphanedEntries = std::erase_if(persistedIndex, [&names](const auto& entry) { return !names.count(entry.first); });
+		if (countOfOrphanedEntries == 0)
+			sessionsHistory->markPersisted();
 	}
 
-	static void writeSessionsMetadata(SessionsHistory* sessionsHistory) {
-		deleteMetadataForDeletedSessions(sessionsHistory, METADATA_DIRECTORY);
+	static void readSessionsJournals(Editor* editor) {
+		TraceScope trace("FilesManager::readSessionsJournals");
+		if (!std::filesystem::exists(JOURNAL_DIRECTORY))
+			return;
 
-		if (!std::filesystem::exists(METADATA_DIRECTORY))
-			std::filesystem::create_directories(METADATA_DIRECTORY);
+		std::stack<std::string> available_sessions = getFilepathsForMetadata(JOURNAL_DIRECTORY);
+		std::unordered_map<std::string, SessionIndexEntry>& index = persistedIndex = readSessionsIndex();
+		std::vector<std::string> journals;
 
-		for (int i = 0; i < sessionsHistory->size(); i++)
-			writeSessionMetadata(sessionsHistory, i);
+		for (int i = 0; i < available_sessions.size(); i++) {
+			std::string filepath = available_sessions._Get_container()[i];
+			std::filesystem::path extension = std::filesystem::path(filepath).extension();
+
+			if (extension == ".tmp")
+				remove(filepath.c_str()); //залишок переписування журналу, яке не завершилось
+			else if (extension != ".index")
+				journals.push_back(filepath);
+		}
+
+		//журнали читаються паралельно, а сеанси додаються в порядку файлів, тож порядок не залежить від потоків
+		std::vector<Session*> sessions(journals.size(), nullptr);
+		WorkersPool::forEachIndex(journals.size(), [&journals, &index, &sessions](size_t i) {
+			sessions[i] = readSessionJournal(journals[i], index);
+			});
+		for (Session* session : sessions)
+			if (session)
+				editor->getSessionsHistory()->addSessionToEnd(session);
 	}
-	static void writeSessionMetadata(SessionsHistory* sessionsHistory, int index) {
-		Session* session = sessionsHistory->getSessionByIndex(index);
+	//створює сеанс без історії: вона буде прочитана з журналу лише тоді, коли сеанс відкриють
+	static Session* readSessionJournal(std::string filepath, const std::unordered_map<std::string, SessionIndexEntry>& index) {
+		TraceScope trace("FilesManager::readSessionJournal");
+		Session* session = new Session(filepath.substr(JOURNAL_DIRECTORY.size()));
+		std::error_code error;
+		auto entry = index.find(session->getName());
+
+		if (entry != index.end() && entry->second.sizeOfJournal == std::filesystem::file_size(filepath, error)) {
+			session->setUnloadedHistory(entry->second.countOfCommands, entry->second.currentCommandIndex);
+			session->markPersisted();
+		}
+		else {
+			//індекс застарів (наприклад, програма аварійно завершилась): рахуємо команди, не розбираючи тексти змін
+			int countOfCommands = 0, currentIndex = -1;
+			int countOfRecords = CommandsJournal::replay(filepath, [&countOfCommands, &currentIndex](JournalOpcode opcode, std::vector<TextDelta>&) {
+				if (opcode == JournalOpcode::Undo)
+					currentIndex = std::max(currentIndex - 1, -1);
+				else if (opcode == JournalOpcode::Redo)
+					currentIndex = std::min(currentIndex + 1, countOfCommands - 1);
+				else if (opcode == JournalOpcode::Continue && currentIndex > -1)
+					countOfCommands = currentIndex + 1;
+				else
+					countOfCommands = ++currentIndex + 1;
+				}, false);
 
-		std::ofstream ofs_session(METADATA_DIRECTORY + session->getName());
+			if (countOfRecords == -1) {
+				delete session;
+				return nullptr;
+			}
+			session->setUnloadedHistory(countOfCommands, currentIndex);
+		}
 
-		ofs_session << session->sizeOfCommandsHistory() << std::endl;
-		ofs_session << session->getCurIndexInCommHistory() << std::endl;
+		session->setJournal(new CommandsJournal(filepath));
+		attachSessionFiles(session);
+		return session;
+	}
+	static void replayJournalRecord(Editor* editor, Session* session, JournalOpcode opcode, std::vector<TextDelta>& deltas) {
+		int currentIndex = session->getCurIndexInCommHistory();
 
-		for (int j = 0; j < session->sizeOfCommandsHistory(); j++)
-			writeCommandMetadata(&ofs_session, session, j);
+		switch (opcode)
+		{
+		case JournalOpcode::Undo:
+			if (currentIndex > -1)
+				session->setCurIndexInCommHistory(currentIndex - 1);
+			return;
+		case JournalOpcode::Redo:
+			if (currentIndex < session->sizeOfCommandsHistory() - 1)
+				session->setCurIndexInCommHistory(currentIndex + 1);
+			return;
+		case JournalOpcode::Paste:
+		case JournalOpcode::Cut:
+		case JournalOpcode::Delete:
+		case JournalOpcode::ReplaceAll:
+			while (session->sizeOfCommandsHistory() - 1 > currentIndex)
+				session->deleteLastCommand();
+
+			session->addCommandAsLast(getCommandTypeOfOpcode(opcode), deltas.data(), deltas.size());
+			session->setCurIndexInCommHistory(currentIndex + 1);
+			return;
+		case JournalOpcode::Continue:
+			while (session->sizeOfCommandsHistory() - 1 > currentIndex)
+				session->deleteLastCommand();
 
-		ofs_session.close();
+			if (!(currentIndex > -1 && deltas.size() == 1 && session->getCommandsHistory()->coalesce(deltas[0]))) {
+				session->addCommandAsLast(CommandType::Paste, deltas.data(), deltas.size());
+				session->setCurIndexInCommHistory(currentIndex + 1);
+			}
+		}
 	}
-	static void writeCommandMetadata(std::ofstream* ofs_session, Session* session, int index) {
-		std::string typeOfCommand, nameOfCommandClass, delimiter = "---\n";
-		Command* command = session->getCommandByIndex(index);
+	static void unloadColdSessions(SessionsHistory* sessionsHistory, Session* currentSession) {
+		size_t sizeOfLoadedHistories = 0;
+		std::vector<Session*> loadedSessions;
+
+		for (int i = 0; i < sessionsHistory->size(); i++) {
+			Session* session = sessionsHistory->getSessionByIndex(i);
+			if (session->getIsHistoryLoaded() && session != currentSession) {
+				sizeOfLoadedHistories += session->getSizeOfHistoryInBytes();
+				loadedSessions.push_back(session);
+			}
+		}
+		sizeOfLoadedHistories += currentSession->getSizeOfHistoryInBytes();
 
-		nameOfCommandClass = std::string(typeid(*command).name());
+		std::sort(loadedSessions.begin(), loadedSessions.end(), [](Session* a, Session* b) {
+			return a->getLastUse() < b->getLastUse();
+			});
 
-		if (nameOfCommandClass == "class PasteCommand")
-			typeOfCommand = "PasteCommand";
-		else if (nameOfCommandClass == "class CutCommand")
-			typeOfCommand = "CutCommand";
-		else
-			typeOfCommand = "DeleteCommand";
+		for (size_t i = 0; i < loadedSessions.size() && sizeOfLoadedHistories > HISTORY_MEMORY_BUDGET; i++) {
+			sizeOfLoadedHistories -= loadedSessions[i]->getSizeOfHistoryInBytes();
+			loadedSessions[i]->unloadHistory();
+		}
+	}
+	static bool compactSessionJournal(Session* session) {
+		std::vector<std::string> records;
 
-		*ofs_session << typeOfCommand << std::endl << delimiter;
+		for (int i = 0; i < session->sizeOfCommandsHistory(); i++) {
+			std::vector<TextDelta> deltas;
+			if (!session->getCommandsHistory()->getDeltasByIndex(i, deltas))
+				return false;
+			records.push_back(CommandsJournal::encodeRecord(getOpcodeOfCommandType(session->getCommandsHistory()->getTypeByIndex(i)),
+				deltas.data(), deltas.size()));
+		}
+		for (int i = session->sizeOfCommandsHistory() - 1; i > session->getCurIndexInCommHistory(); i--)
+			records.push_back(CommandsJournal::encodeRecord(JournalOpcode::Undo));
 
-		if (command->getTextToProcess() != "")
-			*ofs_session << command->getTextToProcess() << std::endl;
+		if (!std::filesystem::exists(JOURNAL_DIRECTORY))
+			std::filesystem::create_directories(JOURNAL_DIRECTORY);
 
-		*ofs_session << delimiter;
+		return CommandsJournal::rewrite(JOURNAL_DIRECTORY + session->getName(), records);
 	}
 
 	static void readSessionsMetadata(Editor* editor) {
+		TraceScope trace("FilesManager::readSessionsMetadata");
 		if (!std::filesystem::exists(METADATA_DIRECTORY))
 			return;
 
 		std::stack<std::string> available_sessions;
+		std::vector<std::string> filepaths;
 
 		available_sessions = getFilepathsForMetadata(METADATA_DIRECTORY);
 
-		for (int i = 0; i < available_sessions.size(); i++)
-			readSessionMetadata(editor, available_sessions._Get_container()[i]);
+		//сеанси, що вже мають журнал, не переносяться
+		for (int i = 0; i < available_sessions.size(); i++) {
+			std::string filepath = available_sessions._Get_container()[i];
+			if (editor->getSessionsHistory()->getSessionByName(filepath.substr(METADATA_DIRECTORY.size())))
+				remove(filepath.c_str());
+			else
+				filepaths.push_back(filepath);
+		}
+		if (filepaths.empty())
+			return;
+		if (!std::filesystem::exists(JOURNAL_DIRECTORY))
+			std::filesystem::create_directories(JOURNAL_DIRECTORY);
+
+		//розбір метаданих і запис журналів ідуть паралельно, а сеанси додаються в порядку файлів
+		std::vector<Session*> sessions(filepaths.size(), nullptr);
+		WorkersPool::forEachIndex(filepaths.size(), [editor, &filepaths, &sessions](size_t i) {
+			sessions[i] = migrateSessionMetadata(editor, filepaths[i]);
+			});
+		for (size_t i = 0; i < sessions.size(); i++) {
+			if (!sessions[i])
+				continue;
+			openSessionJournal(sessions[i]);
+			editor->getSessionsHistory()->addSessionToEnd(sessions[i]);
+			remove(filepaths[i].c_str());
+		}
 	}
-	static void readSessionMetadata(Editor* editor, std::string filepath) {
-		std::string line;
-		filepath.erase(0, METADATA_DIRECTORY.size());
-		Session* session = new Session(filepath);
-		int countOfCommands;
+	//переносить історію сеансу з метаданих у журнал; nullptr, якщо метадані не прочитались або журнал не записався
+	static Session* migrateSessionMetadata(Editor* editor, std::string filepath) {
+		TraceScope trace("FilesManager::migrateSessionMetadata");
+		Session* session = readSessionMetadata(editor, filepath);
+		if (session && !compactSessionJournal(session)) {
+			delete session;
+			return nullptr;
+		}
+		return session;
+	}
+	static Session* readSessionMetadata(Editor* editor, std::string filepath) {
+		std::string_view countOfCommandsLine, currentIndexLine;
+		MappedFile file;
 
-		std::ifstream ifs_session(METADATA_DIRECTORY + filepath);
+		if (!file.open(filepath))
+			return nullptr;
 
-		getline(ifs_session, line);
-		countOfCommands = stoi(line);
+		LineReader reader(file.data(), file.size());
+		if (!reader.nextLine(countOfCommandsLine) || !reader.nextLine(currentIndexLine))
+			return nullptr;
 
-		getline(ifs_session, line);
-		session->setCurIndexInCommHistory(stoi(line));
+		int countOfCommands, currentIndex;
+		if (!parseNumber(countOfCommandsLine, countOfCommands) || !parseNumber(currentIndexLine, currentIndex) ||
+			countOfCommands < 0 || currentIndex < -1 || currentIndex >= countOfCommands)
+			return nullptr;
 
-		for (int j = 0; j < countOfCommands; j++)
-			readCommandMetadata(editor, &ifs_session, session);
+		filepath.erase(0, METADATA_DIRECTORY.size());
+		Session* session = new Session(filepath);
+		session->setCurIndexInCommHistory(currentIndex);
 
-		editor->getSessionsHistory()->addSessionToEnd(session);
+		std::string previousText; //для метаданих старого формату, де замість змін зберігався весь текст після кожної команди
+		for (int j = 0; j < countOfCommands; j++)
+			if (!readCommandMetadata(editor, &reader, session, previousText)) {
+				delete session;
+				return nullptr;
+			}
 
-		ifs_session.close();
+		return session;
 	}
-	static void readCommandMetadata(Editor* editor, std::ifstream* ifs_session, Session* session) {
-		std::string typeOfCommand, text;
-		Command* command,* previousCommand;
+	//false, якщо запис команди обрізаний або пошкоджений
+	static bool readCommandMetadata(Editor* editor, LineReader* reader, Session* session, std::string& previousText) {
+		std::string_view typeOfCommand, line;
+		TextDelta delta;
 
-		getline(*ifs_session, typeOfCommand);
-		if (typeOfCommand == "CutCommand")
-			command = new CutCommand(editor);
-		else if (typeOfCommand == "PasteCommand")
-			command = new PasteCommand(editor);
-		else
-			command = new DeleteCommand(editor);
+		if (!reader->nextLine(typeOfCommand) || !reader->nextLine(line))
+			return false;
+		CommandType type = typeOfCommand == "CutCommand" ? CommandType::Cut :
+			typeOfCommand == "PasteCommand" ? CommandType::Paste : CommandType::Delete;
 
-		if (session->sizeOfCommandsHistory() > 0)
-		{
-			previousCommand = session->getCommandByIndex(session->sizeOfCommandsHistory() - 1);
-			command->setPreviousCommand(previousCommand);
+		if (line == "---") {
+			std::string text;
+			if (!readDataByDelimiter(reader, "---", text, false))
+				return false;
+			delta = makeDeltaBetweenTexts(previousText, text);
+			previousText = std::move(text);
 		}
+		else if (!parseNumber(line, delta.position) || !readDataByDelimiter(reader, "---", delta.removedText) ||
+			!readDataByDelimiter(reader, "---", delta.insertedText))
+			return false;
 
-		text = readDataByDelimiter(ifs_session, "---");
-		command->setTextToProcess(text);
-
-		session->addCommandAsLast(command);
+		session->addCommandAsLast(type, &delta);
+		return true;
+	}
+	static TextDelta makeDeltaBetweenTexts(const std::string& before, const std::string& after) {
+		size_t prefix = 0, suffix = 0;
+		while (prefix < before.size() && prefix < after.size() && before[prefix] == after[prefix])
+			prefix++;
+		while (suffix < before.size() - prefix && suffix < after.size() - prefix &&
+			before[before.size() - 1 - suffix] == after[after.size() - 1 - suffix])
+			suffix++;
+
+		TextDelta delta;
+		delta.position = prefix;
+		delta.removedText = before.substr(prefix, before.size() - prefix - suffix);
+		delta.insertedText = after.substr(prefix, after.size() - prefix - suffix);
+		return delta;
 	}
 
 public:
+	//шукає в збережених файлах усіх сеансів; тимчасові файли незавершених записів пропускаються
+	static void searchInSessionsData(const std::string& pattern, const std::function<bool(const SessionsSearcher::Match&)>& onMatch) {
+		std::vector<std::string> filepaths;
+		std::error_code error;
+
+		if (std::filesystem::exists(DATA_DIRECTORY, error))
+			for (const auto& entry : std::filesystem::directory_iterator(DATA_DIRECTORY, error))
+				if (entry.is_regular_file(error) && entry.path().extension() != ".tmp")
+					filepaths.push_back(entry.path().string());
+
+		std::sort(filepaths.begin(), filepaths.end());
+		SessionsSearcher::search(filepaths, pattern, onMatch);
+	}
 	static std::string getSessionsDirectory() {
 		return DATA_DIRECTORY;
 	}
+	static std::chrono::milliseconds getAutosaveCoalescingWindow() {
+		return AUTOSAVE_COALESCING_WINDOW;
+	}
+	static std::chrono::milliseconds getMetricsReportInterval() {
+		return METRICS_REPORT_INTERVAL;
+	}
+	//пам'ять спільного сховища фрагментів, яка не належить жодному окремому сеансу
+	static size_t getSizeOfSharedHistory() {
+		return historyChunks.getSizeInMemory();
+	}
+	//звіт записується в тимчасовий файл і підміняє попередній, тож читач ніколи не бачить його наполовину записаним
+	static bool writeMetricsReport() {
+		std::string temporaryFilepath = METRICS_FILEPATH + ".tmp";
+		std::ofstream file(temporaryFilepath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			return false;
 
-	static std::string readSessionData(std::string fullFilepath) {
-		std::string text, line;
+		file << Metrics::toJson(historyChunks.getSizeInMemory());
+		file.close();
+		if (!file) {
+			remove(temporaryFilepath.c_str());
+			return false;
+		}
 
-		std::ifstream file(fullFilepath);
+		std::error_code error;
+		std::filesystem::rename(temporaryFilepath, METRICS_FILEPATH, error);
+		return !error;
+	}
+	static JournalOpcode getOpcodeOfCommandType(CommandType type) {
+		switch (type)
+		{
+		case CommandType::Paste: return JournalOpcode::Paste;
+		case CommandType::Cut: return JournalOpcode::Cut;
+		case CommandType::ReplaceAll: return JournalOpcode::ReplaceAll;
+		case CommandType::Undo: return JournalOpcode::Undo;
+		case CommandType::Redo: return JournalOpcode::Redo;
+		default: return JournalOpcode::Delete;
+		}
+	}
 
-		int counterOfLines = 0;
+	static void openSessionJournal(Session* session) {
+		if (!std::filesystem::exists(JOURNAL_DIRECTORY))
+			std::filesystem::create_directories(JOURNAL_DIRECTORY);
 
-		while (getline(file, line))
-		{
-			counterOfLines++;
-			if (counterOfLines > 1)
-				line = "\n" + line;
-			text += line;
+		CommandsJournal* journal = new CommandsJournal(JOURNAL_DIRECTORY + session->getName());
+		journal->open();
+		session->setJournal(journal);
+		attachSessionFiles(session);
+	}
+	//завантажує історію сеансу з журналу, якщо вона ще не в пам'яті, і за потреби вивантажує давно не відкривані сеанси
+	static void loadSessionHistory(Editor* editor, Session* session) {
+		ScopedLatency latency(MeasuredOperation::LoadSessionHistory);
+		session->markAsUsed();
+
+		if (!session->getIsHistoryLoaded()) {
+			session->setHistoryAsLoaded();
+			session->setCurIndexInCommHistory(-1);
+
+			session->getJournal()->close();
+			int countOfRecords = CommandsJournal::replay(session->getJournal()->getFilepath(), [editor, session](JournalOpcode opcode, std::vector<TextDelta>& deltas) {
+				replayJournalRecord(editor, session, opcode, deltas);
+				});
+
+			//журнал зберігає і скасовані гілки історії, тому час від часу його варто стиснути до актуальних команд
+			if (countOfRecords > 2 * session->sizeOfCommandsHistory() + 64 && compactSessionJournal(session))
+				session->markChanged(); //розмір журналу в індексі більше не дійсний
 		}
 
-		file.close();
+		unloadColdSessions(editor->getSessionsHistory(), session);
+	}
+	static void closeSessionsJournals(SessionsHistory* sessionsHistory) {
+		for (int i = 0; i < sessionsHistory->size(); i++)
+			if (sessionsHistory->getSessionByIndex(i)->getJournal())
+				sessionsHistory->getSessionByIndex(i)->getJournal()->close();
+	}
+	static void deleteSessionJournal(std::string filename) {
+		std::string filepath = JOURNAL_DIRECTORY + filename;
+		remove(filepath.c_str());
+		persistedIndex.erase(filename);
+		Metrics::forgetSession(filename);
+
+		filepath = CLIPBOARD_DIRECTORY + filename;
+		remove(filepath.c_str());
+	}
+
+	static void attachSessionFiles(Session* session) {
+		if (IS_CLIPBOARD_PERSISTENT)
+			session->getClipboard()->setFilepath(CLIPBOARD_DIRECTORY + session->getName());
+		session->getCommandsHistory()->setSpillFile(HISTORY_SPILL_DIRECTORY + session->getName(), SESSION_HISTORY_MEMORY_BUDGET);
+		session->getCommandsHistory()->setChunkStore(&historyChunks);
+	}
+	//витіснені тексти потрібні лише до завершення програми; залишки після аварійного завершення видаляються
+	static void removeHistorySpills() {
+		std::error_code error;
+		std::filesystem::remove_all(HISTORY_SPILL_DIRECTORY, error);
+		std::filesystem::remove(CHUNKS_FILEPATH, error);
+	}
+	//перенесені великі файли потрібні лише до завершення програми; якщо ж аварійне завершення сталося між перенесенням
+	//і заміною файлу сеансу новим, перенесений файл - єдина копія, і він повертається на місце
+	static void restoreMovedOriginals() {
+		std::error_code error;
+		if (!std::filesystem::exists(MOVED_ORIGINALS_DIRECTORY, error))
+			return;
+
+		for (const auto& entry : std::filesystem::directory_iterator(MOVED_ORIGINALS_DIRECTORY, error)) {
+			std::string filepath = DATA_DIRECTORY + entry.path().filename().string();
+			if (!std::filesystem::exists(filepath, error))
+				std::filesystem::rename(entry.path(), filepath, error);
+		}
+		std::filesystem::remove_all(MOVED_ORIGINALS_DIRECTORY, error);
+	}
+	//буфер обміну змінюється лише командами, тож переглядаються тільки сеанси, змінені з останнього запису
+	static void saveSessionsClipboards(SessionsHistory* sessionsHistory) {
+		TraceScope trace("FilesManager::saveSessionsClipboards");
+		if (!IS_CLIPBOARD_PERSISTENT)
+			return;
+
+		for (int i = 0; i < sessionsHistory->size(); i++) {
+			Session* session = sessionsHistory->getSessionByIndex(i);
+			if (!session->isChangedSincePersisted())
+				continue;
+			if (!std::filesystem::exists(CLIPBOARD_DIRECTORY))
+				std::filesystem::create_directories(CLIPBOARD_DIRECTORY);
+			session->getClipboard()->save();
+		}
+	}
+
+	//великі файли не читаються: текст посилається на їх відображення, і пам'ять займають лише правки.
+	//Такі файли редагуються байт у байт, без перетворення переводів рядків
+	static TextBuffer* readSessionText(std::string fullFilepath) {
+		ScopedLatency latency(MeasuredOperation::ReadSessionText);
+		std::error_code error;
+		if (std::filesystem::file_size(fullFilepath, error) >= LARGE_FILE_THRESHOLD && !error) {
+			std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+			//великий файл не перекодовується, але якщо це UTF-8, позиції в ньому рахуються символами
+			if (file->open(fullFilepath)) {
+				TextBuffer* text = new TextBuffer(file);
+				if (isUtf8Prefix(file->data(), file->size()))
+					text->setEncoding(TextEncoding::Utf8, TextEncoding::Utf8);
+				return text;
+			}
+		}
 
+		std::string data = readSessionData(fullFilepath);
+		if (!isUtf8Text(data.data(), data.size()))
+			return new TextBuffer(std::move(data));
+
+		//UTF-8 перекодовується в кодування консолі, якщо в ньому є всі символи тексту: тоді кожен символ - один байт,
+		//і текст редагується як звичайно, а при збереженні знову записується в UTF-8
+		std::string converted;
+		converted.reserve(data.size());
+		bool isLossless = Cp1251::appendFromUtf8(data.data(), data.size(), converted);
+		TextBuffer* text = new TextBuffer(isLossless ? std::move(converted) : std::move(data));
+		text->setEncoding(isLossless ? TextEncoding::Cp1251 : TextEncoding::Utf8, TextEncoding::Utf8);
 		return text;
 	}
+	//текст з не-ASCII символами, що є коректним UTF-8, вважається записаним в UTF-8: текст у Windows-1251 майже ніколи ним не буває
+	static bool isUtf8Text(const char* data, size_t length) {
+		return Utf8::lengthOfAscii(data, length) < length && Utf8::isValid(data, length);
+	}
+	//для відображених файлів кодування визначається за обмеженим початком, щоб відкриття не переглядало весь файл ще раз:
+	//перевіряється фрагмент від першого не-ASCII байта, обрізаний до межі символу
+	static bool isUtf8Prefix(const char* data, size_t length) {
+		const size_t SIZE_OF_ASCII_PREFIX = 1024 * 1024, SIZE_OF_CHECKED_PART = 64 * 1024;
+		size_t start = Utf8::lengthOfAscii(data, std::min(length, SIZE_OF_ASCII_PREFIX));
+		if (start == std::min(length, SIZE_OF_ASCII_PREFIX))
+			return false;
+
+		size_t end = std::min(length, start + SIZE_OF_CHECKED_PART);
+		if (end < length)
+			while (end > start && Utf8::isContinuation(data[end]))
+				end--;
+		return Utf8::isValid(data + start, end - start);
+	}
+	static std::string readSessionData(std::string fullFilepath) {
+		MappedFile file;
+
+		if (!file.open(fullFilepath) || file.size() == 0)
+			return "";
 
-	static bool writeSessionData(std::string filename, std::string newData) {
-		std::ofstream file(DATA_DIRECTORY + filename);
+		//як і при построковому читанні: переводи рядків CRLF стають LF, а останній перевод рядка відкидається
+		const char* data = file.data();
+		size_t size = file.size();
+		if (data[size - 1] == '\n')
+			size -= size > 1 && data[size - 2] == '\r' ? 2 : 1;
 
-		if (!file.is_open())
+		std::string text;
+		text.reserve(size);
+
+		size_t offset = 0;
+		while (offset < size) {
+			size_t carriageReturn = offset + ByteScanner::find(data + offset, size - offset, '\r');
+			bool isLineBreak = carriageReturn + 1 < size && data[carriageReturn + 1] == '\n';
+
+			text.append(data + offset, carriageReturn - offset + (isLineBreak || carriageReturn == size ? 0 : 1));
+			offset = carriageReturn + 1;
+		}
+
+		return text;
+	}
+
+	//текст пишеться в тимчасовий файл, який скидається на диск і лише тоді замінює старий, тож аварійне завершення посеред
+	//запису не пошкоджує файл сеансу. Виконується у фоновому потоці над копією тексту, тому читає її через forEachPieceOfSnapshot.
+	//Текст великого файлу пишеться шматками як є, не збираючись у пам'яті
+	static bool writeSessionData(std::string filename, const TextBuffer* newData) {
+		ScopedLatency latency(MeasuredOperation::WriteSessionData);
+		const size_t SIZE_OF_OUTPUT_BUFFER = 1024 * 1024;
+		std::string filepath = DATA_DIRECTORY + filename, temporaryFilepath = filepath + ".tmp";
+		std::shared_ptr<MappedFile> originalFile = newData->getOriginalFile();
+
+		HANDLE file = CreateFileW(std::filesystem::path(temporaryFilepath).c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
 			return false;
 
-		file << newData;
-		if(!newData.empty() && newData[newData.size() - 1] == '\n')
-			file << '\n';
+		std::string output;
+		bool isWritten = true;
+		auto writeOutput = [&file, &output, &isWritten]() {
+			DWORD written;
+			isWritten = isWritten && (output.empty() || (WriteFile(file, output.data(), (DWORD)output.size(), &written, nullptr) && written == output.size()));
+			output.clear();
+			return isWritten;
+		};
+
+		//як і текстовий потік раніше: кожен символ нового рядка записується як \r\n (крім великих файлів);
+		//текст файлу в UTF-8, який редагувався в кодуванні консолі, перекодовується назад
+		bool isConvertingNewlines = !originalFile;
+		bool isConvertingToUtf8 = newData->getEncoding() == TextEncoding::Cp1251 && newData->getEncodingOfFile() == TextEncoding::Utf8;
+		char lastByte = '\0'; //запам'ятовується тут же: буфер вставок оригіналу можна читати лише під блокуванням, як це робить forEachPieceOfSnapshot
+		output.reserve(SIZE_OF_OUTPUT_BUFFER + 2);
+		newData->forEachPieceOfSnapshot([&output, &writeOutput, &lastByte, isConvertingNewlines, isConvertingToUtf8, SIZE_OF_OUTPUT_BUFFER](const char* data, size_t length) {
+			if (length > 0)
+				lastByte = data[length - 1];
+			for (size_t offset = 0; offset < length;) {
+				size_t lengthOfPart = std::min(length - offset, SIZE_OF_OUTPUT_BUFFER - std::min(output.size(), SIZE_OF_OUTPUT_BUFFER));
+				size_t newline = isConvertingNewlines ? ByteScanner::find(data + offset, lengthOfPart, '\n') : lengthOfPart;
+
+				if (isConvertingToUtf8)
+					Cp1251::appendAsUtf8(data + offset, std::min(newline, lengthOfPart), output);
+				else
+					output.append(data + offset, std::min(newline, lengthOfPart));
+				if (newline < lengthOfPart) {
+					output += "\r\n";
+					offset += newline + 1;
+				}
+				else
+					offset += lengthOfPart;
 
-		file.close();
+				if (output.size() >= SIZE_OF_OUTPUT_BUFFER && !writeOutput())
+					return false;
+			}
+			return true;
+			});
+		if (isConvertingNewlines && lastByte == '\n')
+			output += "\r\n";
+
+		isWritten = writeOutput() && FlushFileBuffers(file);
+		CloseHandle(file);
+
+		//відображений файл сеансу не можна замінити, тому він переноситься і живе там, доки на нього посилаються тексти
+		bool isOriginalMoved = false;
+		if (isWritten && originalFile && originalFile->getFilepath() == filepath) {
+			std::error_code error;
+			std::filesystem::create_directories(MOVED_ORIGINALS_DIRECTORY, error);
+			isWritten = isOriginalMoved = originalFile->moveTo(MOVED_ORIGINALS_DIRECTORY + filename, true);
+		}
 
+		if (!isWritten || !MoveFileExW(std::filesystem::path(temporaryFilepath).c_str(), std::filesystem::path(filepath).c_str(),
+			MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+			if (isOriginalMoved)
+				originalFile->moveTo(filepath, false);
+			remove(temporaryFilepath.c_str());
+			return false;
+		}
 		return true;
 	}
 };
 
 const std::string FilesManager::METADATA_DIRECTORY = "Metadata\\",
-FilesManager::DATA_DIRECTORY = "Data\\";
-
-void Editor::tryToLoadSessions() { FilesManager::readSessionsMetadata(this); }
-void Editor::tryToUnloadSessions() { FilesManager::writeSessionsMetadata(sessionsHistory); }
+FilesManager::JOURNAL_DIRECTORY = "Journal\\",
+FilesManager::SESSIONS_INDEX_FILEPATH = FilesManager::JOURNAL_DIRECTORY + "sessions.index",
+FilesManager::DATA_DIRECTORY = "Data\\",
+FilesManager::CLIPBOARD_DIRECTORY = "Clipboard\\",
+FilesManager::HISTORY_SPILL_DIRECTORY = "History\\",
+FilesManager::CHUNKS_FILEPATH = "History.chunks",
+FilesManager::MOVED_ORIGINALS_DIRECTORY = "Originals\\",
+FilesManager::METRICS_FILEPATH = "Metrics.json";
+const bool FilesManager::IS_CLIPBOARD_PERSISTENT = true;
+const std::chrono::milliseconds FilesManager::AUTOSAVE_COALESCING_WINDOW(500);
+const std::chrono::milliseconds FilesManager::METRICS_REPORT_INTERVAL(10000);
+const size_t FilesManager::SESSION_HISTORY_MEMORY_BUDGET = 8 * 1024 * 1024;
+const size_t FilesManager::HISTORY_MEMORY_BUDGET = 64 * 1024 * 1024;
+const size_t FilesManager::CHUNKS_MEMORY_BUDGET = 32 * 1024 * 1024;
+std::unordered_map<std::string, FilesManager::SessionIndexEntry> FilesManager::persistedIndex;
+const uint64_t FilesManager::LARGE_FILE_THRESHOLD = 256ull * 1024 * 1024;
+ChunkStore FilesManager::historyChunks(FilesManager::CHUNKS_FILEPATH, FilesManager::CHUNKS_MEMORY_BUDGET);
+
+void Editor::tryToLoadSessions() {
+	ScopedLatency latency(MeasuredOperation::LoadSessions);
+	FilesManager::removeHistorySpills();
+	FilesManager::restoreMovedOriginals();
+	FilesManager::readSessionsJournals(this);
+	FilesManager::readSessionsMetadata(this);
+	FilesManager::removeOrphanedFiles(sessionsHistory);
+}
+//буфери обміну зберігаються до індексу, бо запис індексу позначає сеанси збереженими
+void Editor::tryToUnloadSessions() {
+	ScopedLatency latency(MeasuredOperation::SaveSessions);
+	FilesManager::closeSessionsJournals(sessionsHistory);
+	FilesManager::saveSessionsClipboards(sessionsHistory);
+	FilesManager::writeSessionsIndex(sessionsHistory);
+}
 
 Editor::Editor() { this->sessionsHistory = new SessionsHistory(); }
 
-void Editor::copy(std::string textToProcess, int startPosition, int endPosition) {
-	std::string dataToCopy = textToProcess.substr(startPosition, endPosition - startPosition + 1);
-	currentSession->addDataToClipboard(dataToCopy);
+void Editor::copy(TextBuffer* textToProcess, int startPosition, int endPosition) {
+	TraceScope trace("Editor::copy");
+	currentSession->addDataToClipboard(textToProcess, startPosition, endPosition - startPosition + 1);
 }
-void Editor::paste(std::string* textToProcess, int startPosition, int endPosition, std::string textToPaste) {
+TextDelta Editor::paste(TextBuffer* textToProcess, int startPosition, int endPosition, std::string textToPaste) {
+	ScopedLatency latency(MeasuredOperation::EditorPaste);
+	size_t position, countToReplace;
+
 	if (startPosition == endPosition) {
-		if(startPosition == 0)
-			*textToProcess = textToPaste + *textToProcess;
-		else if(startPosition == textToProcess->size() - 1)
-			*textToProcess += textToPaste;
-		else
-			(*textToProcess).replace(startPosition, endPosition - startPosition + 1, textToPaste);
+		if (startPosition == 0) {
+			position = 0;
+			countToReplace = 0;
+		}
+		else if (startPosition == textToProcess->size() - 1) {
+			position = textToProcess->size();
+			countToReplace = 0;
+		}
+		else {
+			position = startPosition;
+			countToReplace = endPosition - startPosition + 1;
+		}
 	}
 	else
 	{
-		if(endPosition == -1)
-			(*textToProcess).replace(0, 1, textToPaste);
-		else if (endPosition == textToProcess->size()) 
-			(*textToProcess).replace(textToProcess->size() - 1, textToProcess->size() - 1, textToPaste);
-		else
-			(*textToProcess).replace(startPosition, endPosition - startPosition + 1, textToPaste);
+		if (endPosition == -1) {
+			position = 0;
+			countToReplace = 1;
+		}
+		else if (endPosition == textToProcess->size()) {
+			position = textToProcess->size() - 1;
+			countToReplace = textToProcess->size() - 1;
+		}
+		else {
+			position = startPosition;
+			countToReplace = endPosition - startPosition + 1;
+		}
 	}
-	*currentText = *textToProcess;
+
+	TextDelta delta;
+	delta.position = std::min(position, textToProcess->size());
+	delta.removedText = textToProcess->substr(delta.position, countToReplace);
+	delta.insertedText = textToPaste;
+	delta.applyTo(textToProcess);
+	return delta;
+}
+//вставка між символами: зміна нічого не видаляє, тож сусідні символи залишаються поза нею
+TextDelta Editor::insert(TextBuffer* textToProcess, size_t position, std::string textToInsert) {
+	ScopedLatency latency(MeasuredOperation::EditorInsert);
+	TextDelta delta;
+	delta.position = std::min(position, textToProcess->size());
+	delta.insertedText = std::move(textToInsert);
+	delta.applyTo(textToProcess);
+	return delta;
+}
+TextDelta Editor::cut(TextBuffer* textToProcess, int startPosition, int endPosition) {
+	ScopedLatency latency(MeasuredOperation::EditorCut);
+	copy(textToProcess, startPosition, endPosition);
+	return remove(textToProcess, startPosition, endPosition);
 }
-void Editor::cut(std::string* textToProcess, int startPosition, int endPosition) {
-	copy(*textToProcess, startPosition, endPosition);
-	remove(textToProcess, startPosition, endPosition);
-	*currentText = *textToProcess;
+TextDelta Editor::remove(TextBuffer* textToProcess, int startPosition, int endPosition) {
+	ScopedLatency latency(MeasuredOperation::EditorRemove);
+	TextDelta delta;
+	delta.position = std::min<size_t>(startPosition, textToProcess->size());
+	delta.removedText = textToProcess->substr(startPosition, endPosition - startPosition + 1);
+	delta.applyTo(textToProcess);
+	return delta;
 }
-void Editor::remove(std::string* textToProcess, int startPosition, int endPosition) {
-	(*textToProcess).erase(startPosition, endPosition - startPosition + 1);
-	*currentText = *textToProcess;
+
+std::vector<TextDelta> Editor::findReplacements(TextBuffer* textToProcess, const std::vector<std::pair<std::string, std::string>>& replacements) {
+	std::vector<std::string> patterns;
+	for (const auto& replacement : replacements)
+		patterns.push_back(replacement.first);
+
+	AhoCorasick automaton(patterns);
+	std::vector<TextDelta> deltas;
+
+	for (const AhoCorasick::Match& match : automaton.findLeftmostLongest(textToProcess)) {
+		TextDelta delta;
+		delta.position = match.position;
+		delta.removedText = replacements[match.patternIndex].first;
+		delta.insertedText = replacements[match.patternIndex].second;
+		deltas.push_back(std::move(delta));
+	}
+
+	return deltas;
 }
 
 Session* Editor::getCurrentSession() { return currentSession; }
-std::string* Editor::getCurrentText() { return currentText; }
+TextBuffer* Editor::getCurrentText() { return currentText; }
 SessionsHistory* Editor::getSessionsHistory() { return sessionsHistory; }
 void Editor::setCurrentSession(Session* session) { currentSession = session; }
-void Editor::setCurrentText(std::string* text) { currentText = text; }
+void Editor::setCurrentText(TextBuffer* text) { currentText = text; }
 
+//у консолі виводиться лише те, що вміщається у вікно над меню, тож перемалювання не залежить від розміру файлу
 void Editor::printCurrentText() {
-	system("cls");
+	const size_t ROWS_RESERVED_FOR_MENU = 20;
+
+	ConsoleRenderer::beginFrame();
 	std::cout << "\nЗміст файлу " << currentSession->getName() << ":\n";
-	*currentText != "" ? 
-		std::cout << "\"" << *currentText << "\"\n" : 
+	if (currentText->empty()) {
 		std::cout << "\nФайл пустий!\n";
+		return;
+	}
+
+	size_t countOfFreeRows = ConsoleRenderer::getCountOfFreeRows(ROWS_RESERVED_FOR_MENU);
+	size_t widthOfConsole = ConsoleRenderer::getWidthOfConsole();
+	size_t countOfRows = 1, lengthOfRow = 0, countOfPrintedBytes = 0;
+	bool isTextCut = false, isInUtf8 = currentText->getEncoding() == TextEncoding::Utf8;
+	std::string textInUtf8; //перекодовується для консолі цілим, бо межа шматків може розрізати символ
+
+	std::cout << "\"";
+	currentText->forEachPiece([&](const char* data, size_t length) {
+		size_t countToPrint = length;
+		for (size_t i = 0; countOfFreeRows && i < length; i++) {
+			lengthOfRow = data[i] == '\n' ? 0 : lengthOfRow + (isInUtf8 && Utf8::isContinuation(data[i]) ? 0 : 1);
+			if (data[i] == '\n' || lengthOfRow > widthOfConsole) {
+				lengthOfRow = data[i] == '\n' ? 0 : 1;
+				if (++countOfRows > countOfFreeRows) {
+					countToPrint = i;
+					isTextCut = true;
+					break;
+				}
+			}
+		}
+		if (isInUtf8)
+			textInUtf8.append(data, countToPrint);
+		else
+			std::cout.write(data, countToPrint);
+		countOfPrintedBytes += countToPrint;
+		return !isTextCut;
+		});
+	std::cout << Cp1251::fromUtf8(textInUtf8);
+
+	if (isTextCut)
+		std::cout << "\n... (показано " << countOfPrintedBytes << " з " << currentText->size() << " байтів)\n";
+	else
+		std::cout << "\"\n";
+}
+
+//лише рядки сторінки з їх номерами; рядки, довші за ширину вікна, обрізаються і позначаються символом '>'
+void Editor::printPageOfCurrentText(size_t firstLine, size_t countOfLinesOnPage) {
+	size_t countOfLines = currentText->countOfLines();
+	size_t lastLine = std::min(countOfLines, firstLine + countOfLinesOnPage);
+	size_t widthOfNumber = std::to_string(countOfLines).size();
+	size_t widthOfConsole = ConsoleRenderer::getWidthOfConsole();
+	size_t maxLengthOfLine = widthOfConsole > widthOfNumber + 4 ? widthOfConsole - widthOfNumber - 4 : TextBuffer::npos;
+
+	ConsoleRenderer::beginFrame();
+	std::cout << "\nЗміст файлу " << currentSession->getName() << " (рядки " << firstLine + 1 << "-" << lastLine << " з " << countOfLines << "):\n";
+	for (size_t line = firstLine; line < lastLine; line++) {
+		std::string number = std::to_string(line + 1);
+		size_t lengthOfLine = currentText->lengthOfLine(line);
+
+		std::cout << std::string(widthOfNumber - number.size(), ' ') << number << " | ";
+		if (currentText->getEncoding() == TextEncoding::Utf8) {
+			//ширина рядка в UTF-8 рахується символами
+			size_t startOfLine = currentText->offsetOfLine(line), firstCodepoint = currentText->codepointOfOffset(startOfLine);
+			size_t codepointsInLine = currentText->codepointOfOffset(startOfLine + lengthOfLine) - firstCodepoint;
+			size_t endOfPage = codepointsInLine > maxLengthOfLine ? currentText->offsetOfCodepoint(firstCodepoint + maxLengthOfLine - 1) : startOfLine + lengthOfLine;
+			std::cout << Cp1251::fromUtf8(currentText->substr(startOfLine, endOfPage - startOfLine)) << (codepointsInLine > maxLengthOfLine ? ">\n" : "\n");
+		}
+		else if (lengthOfLine > maxLengthOfLine)
+			std::cout << currentText->substr(currentText->offsetOfLine(line), maxLengthOfLine - 1) << ">\n";
+		else
+			std::cout << currentText->substr(currentText->offsetOfLine(line), lengthOfLine) << "\n";
+	}
 }
 
 SessionsHistory* Editor::sessionsHistory;
 Session* Editor::currentSession;
-std::string* Editor::currentText;
+TextBuffer* Editor::currentText;
 
-CopyCommand::CopyCommand(Editor* editor) { this->editor = editor; }
+unsigned long long Session::counterOfUses = 0;
+
+//фонове збереження текстів сеансів: редагування лише передає копію дерева шматків (байти тексту вона ділить з оригіналом),
+//а окремий потік записує файл, коли після останньої зміни минає вікно об'єднання, тож серія правок дає один запис
+class SessionsAutosaver {
+private:
+	struct PendingSave {
+		TextBuffer* snapshot; //найновіший стан тексту
+		std::chrono::steady_clock::time_point deadline, firstChange; //коли записувати і коли з'явилась перша ще не записана зміна
+	};
+
+	static constexpr int MAX_DELAY_IN_WINDOWS = 4; //навіть під час безперервних правок файл записується не рідше, ніж раз на стільки вікон
+
+	std::unordered_map<std::string, PendingSave> pendingSaves; //ім'я файлу сеансу -> ще не записаний знімок
+	std::chrono::milliseconds coalescingWindow;
+	std::mutex mutex;
+	std::condition_variable wakeUp, saved;
+	int countOfSavesInProgress, countOfFlushes;
+	bool isStopping;
+	std::thread worker;
+
+	void run() {
+		Tracer::setThreadName("autosaver");
+		std::unique_lock<std::mutex> lock(mutex);
+
+		while (true) {
+			if (pendingSaves.empty()) {
+				if (isStopping)
+					return;
+				wakeUp.wait(lock);
+				continue;
+			}
 
-void CopyCommand::execute() { editor->copy(textToProcess, startPosition, endPosition); }
-void CopyCommand::undo() { }
-Command* CopyCommand::copy() { return nullptr; }
+			auto next = pendingSaves.begin();
+			for (auto entry = pendingSaves.begin(); entry != pendingSaves.end(); entry++)
+				if (entry->second.deadline < next->second.deadline)
+					next = entry;
 
-DeleteCommand::DeleteCommand(Editor* editor) { this->editor = editor; }
+			bool shouldWait = !isStopping && countOfFlushes == 0;
+			if (shouldWait && std::chrono::steady_clock::now() < next->second.deadline) {
+				wakeUp.wait_until(lock, next->second.deadline);
+				continue;
+			}
 
-void DeleteCommand::execute() { editor->remove(&textToProcess, startPosition, endPosition); }
-void DeleteCommand::undo() { *(Editor::getCurrentText()) = previousCommand->getTextToProcess(); }
-Command* DeleteCommand::copy() { return new DeleteCommand(*this); }
+			std::string filename = next->first;
+			TextBuffer* snapshot = next->second.snapshot;
+			pendingSaves.erase(next);
+			countOfSavesInProgress++;
 
-CutCommand::CutCommand(Editor* editor) { this->editor = editor; }
+			lock.unlock();
+			FilesManager::writeSessionData(filename, snapshot);
+			delete snapshot;
+			lock.lock();
 
-void CutCommand::execute() { editor->cut(&textToProcess, startPosition, endPosition); }
-void CutCommand::undo() { *(Editor::getCurrentText()) = previousCommand->getTextToProcess(); }
-Command* CutCommand::copy() { return new CutCommand(*this); }
+			countOfSavesInProgress--;
+			saved.notify_all();
+		}
+	}
 
-PasteCommand::PasteCommand(Editor* editor) { this->editor = editor; }
+public:
+	SessionsAutosaver(std::chrono::milliseconds coalescingWindow) : coalescingWindow(coalescingWindow),
+		countOfSavesInProgress(0), countOfFlushes(0), isStopping(false) {
+		worker = std::thread(&SessionsAutosaver::run, this);
+	}
+	//перед завершенням записує все, що ще не записане
+	~SessionsAutosaver() {
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			isStopping = true;
+		}
+		wakeUp.notify_all();
+		worker.join();
+	}
 
-void PasteCommand::execute() { editor->paste(&textToProcess, startPosition, endPosition, textToPaste); }
-void PasteCommand::undo() {
-	if (previousCommand)
-		*(Editor::getCurrentText()) = previousCommand->getTextToProcess();
-	else
-		*(Editor::getCurrentText()) = "";
-}
-Command* PasteCommand::copy() { return new PasteCommand(*this); }
+	void schedule(std::string filename, const TextBuffer* text) {
+		TextBuffer* snapshot = new TextBuffer(*text);
+		auto now = std::chrono::steady_clock::now();
+
+		std::lock_guard<std::mutex> guard(mutex);
+		auto entry = pendingSaves.find(filename);
+		if (entry == pendingSaves.end())
+			pendingSaves[filename] = { snapshot, now + coalescingWindow, now };
+		else {
+			delete entry->second.snapshot;
+			entry->second.snapshot = snapshot;
+			entry->second.deadline = std::min(now + coalescingWindow, entry->second.firstChange + MAX_DELAY_IN_WINDOWS * coalescingWindow);
+		}
+		wakeUp.notify_one();
+	}
+	//чекає, доки всі заплановані записи завершаться: перед читанням або видаленням файлів сеансів
+	void flush() {
+		std::unique_lock<std::mutex> lock(mutex);
+		countOfFlushes++;
+		wakeUp.notify_one();
+		saved.wait(lock, [this]() { return pendingSaves.empty() && countOfSavesInProgress == 0; });
+		countOfFlushes--;
+	}
+};
+
+//періодично записує звіт метрик у файл, щоб його можна було читати іншими програмами під час роботи редактора
+class MetricsReporter {
+private:
+	std::chrono::milliseconds interval;
+	std::mutex mutex;
+	std::condition_variable wakeUp;
+	bool isStopping;
+	std::thread worker;
+
+	void run() {
+		Tracer::setThreadName("metrics");
+		std::unique_lock<std::mutex> lock(mutex);
+		while (!isStopping) {
+			if (wakeUp.wait_for(lock, interval, [this]() { return isStopping; }))
+				break;
 
-void UndoCommand::execute() { commandToUndoOrRedo->undo(); }
-void UndoCommand::undo() { }
-Command* UndoCommand::copy() { return nullptr; }
+			lock.unlock();
+			FilesManager::writeMetricsReport();
+			lock.lock();
+		}
+	}
 
-void RedoCommand::execute() { *(Editor::getCurrentText()) = commandToUndoOrRedo->getTextToProcess(); }
-void RedoCommand::undo() { }
-Command* RedoCommand::copy() { return nullptr; }
+public:
+	MetricsReporter(std::chrono::milliseconds interval) : interval(interval), isStopping(false) {
+		worker = std::thread(&MetricsReporter::run, this);
+	}
+	//останній звіт записується при зупинці, тож навіть запуск, коротший за інтервал (як сценарій), залишає метрики всього запуску.
+	//Повторний виклик нічого не робить
+	void stop() {
+		if (!worker.joinable())
+			return;
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			isStopping = true;
+		}
+		wakeUp.notify_all();
+		worker.join();
+		FilesManager::writeMetricsReport();
+	}
+	~MetricsReporter() { stop(); }
+};
 
 class CommandsManager {
 private:
-	std::stack<std::pair<std::string, Command*>> manager; //зберігач усіх команд, дозволяє зручно їми керувати за допомогою поліморфізму
+	Editor* editor; //редактор, в якому відбувається редагування тексту за допомогою команд
+	std::vector<TextDelta> deltasOfCommand; //зміни, внесені останньою командою, перед тим як вони потраплять в історію сеансу
 
-	Command* getCommandFromManagerByKey(std::string typeOfCommand) {
-		for (int i = 0; i < manager.size(); i++)
-			if (manager._Get_container()[i].first == typeOfCommand)
-				return manager._Get_container()[i].second;
+	int getCountOfForwardCommands() {
+		return Editor::getCurrentSession()->sizeOfCommandsHistory() - 1 - Editor::getCurrentSession()->getCurIndexInCommHistory();
+	}
+	void deleteForwardCommandsIfNecessary() {
+		if (isThereAnyCommandForward())
+		{
+			int countOfForwardCommands = getCountOfForwardCommands();
+			for (int i = 0; i < countOfForwardCommands; i++)
+				Editor::getCurrentSession()->deleteLastCommand();
+		}
+	}
+	void writeCommandToJournal(JournalOpcode opcode) {
+		CommandsJournal* journal = Editor::getCurrentSession()->getJournal();
+		if (journal)
+			journal->append(opcode, deltasOfCommand.data(), deltasOfCommand.size());
 	}
-	bool isNotUndoOrRedoCommand(std::string typeOfCommand) { return typeOfCommand != "Undo" && typeOfCommand != "Redo"; }
-	void setParametersForCommand(std::string typeOfCommand, int startPosition, int endPosition, std::string textToPaste) {
-		Command* commandToUndoOrRedo = nullptr, * previousCommand = nullptr;
-
-		if (typeOfCommand == "Undo")
-			commandToUndoOrRedo = Editor::getCurrentSession()->getCommandByIndex(Editor::getCurrentSession()->getCurIndexInCommHistory());
 
-		if(typeOfCommand == "Redo")
-			commandToUndoOrRedo = Editor::getCurrentSession()->getCommandByIndex(Editor::getCurrentSession()->getCurIndexInCommHistory() + 1);
+	//гілка для кожного типу команди обирається під час компіляції, тож виконання не потребує ні віртуальних викликів, ні порівняння рядків.
+	//false лише тоді, коли скасування чи повторення відхилене, бо запис історії не вдалося прочитати
+	template <CommandType type>
+	bool execute(int startPosition, int endPosition, const std::string& textToPaste) {
+		Session* session = Editor::getCurrentSession();
+		TextBuffer* text = Editor::getCurrentText();
+
+		if constexpr (type == CommandType::Copy)
+			editor->copy(text, startPosition, endPosition);
+		else if constexpr (type == CommandType::Undo || type == CommandType::Redo) {
+			int index = session->getCurIndexInCommHistory();
+			bool isApplied;
+			if constexpr (type == CommandType::Undo)
+				isApplied = session->getCommandsHistory()->undo(index, text);
+			else
+				isApplied = session->getCommandsHistory()->redo(++index, text);
+			if (!isApplied)
+				return false;
 
-		if (Editor::getCurrentSession()->getCurIndexInCommHistory() != -1 && isNotUndoOrRedoCommand(typeOfCommand))
-			previousCommand = Editor::getCurrentSession()->getCommandByIndex(Editor::getCurrentSession()->sizeOfCommandsHistory() - 1);
+			writeCommandToJournal(FilesManager::getOpcodeOfCommandType(type));
+			session->setCurIndexInCommHistory(type == CommandType::Undo ? index - 1 : index);
+		}
+		else {
+			deleteForwardCommandsIfNecessary();
 
-		
+			if constexpr (type == CommandType::ReplaceAll) {
+				//з кінця до початку, щоб позиції ще не застосованих замін залишались дійсними
+				for (auto delta = deltasOfCommand.rbegin(); delta != deltasOfCommand.rend(); delta++)
+					delta->applyTo(text);
+			}
+			else if constexpr (type == CommandType::Paste) {
+				//підготовлена вставка між символами застосовується як є, без заміни сусідніх символів
+				if (!deltasOfCommand.empty()) {
+					TextDelta insertion = std::move(deltasOfCommand[0]);
+					deltasOfCommand.assign(1, editor->insert(text, insertion.position, std::move(insertion.insertedText)));
+				}
+				else
+					deltasOfCommand.assign(1, editor->paste(text, startPosition, endPosition, textToPaste));
+			}
+			else if constexpr (type == CommandType::Cut)
+				deltasOfCommand.assign(1, editor->cut(text, startPosition, endPosition));
+			else
+				deltasOfCommand.assign(1, editor->remove(text, startPosition, endPosition));
 
-		getCommandFromManagerByKey(typeOfCommand)->setParameters(typeOfCommand, previousCommand, commandToUndoOrRedo, startPosition, endPosition, textToPaste);
-	}
-	int getCountOfForwardCommands() {
-		return Editor::getCurrentSession()->sizeOfCommandsHistory() - 1 - Editor::getCurrentSession()->getCurIndexInCommHistory();
-	}
-	void deleteForwardCommandsIfNecessary(std::string typeOfCommand) {
-		if (typeOfCommand != "Undo" && typeOfCommand != "Redo" && isThereAnyCommandForward())
-		{
-			int countOfForwardCommands = getCountOfForwardCommands();
-			for (int i = 0; i < countOfForwardCommands; i++)
-				Editor::getCurrentSession()->deleteLastCommand();
+			//коротка правка поруч з попередньою продовжує її, тож не займає окремого кроку скасування
+			if (deltasOfCommand.size() == 1 && session->getCommandsHistory()->canCoalesce(type, deltasOfCommand[0]) &&
+				session->getCommandsHistory()->coalesce(deltasOfCommand[0]))
+				writeCommandToJournal(JournalOpcode::Continue);
+			else {
+				writeCommandToJournal(FilesManager::getOpcodeOfCommandType(type));
+				session->addCommandAsLast(type, deltasOfCommand.data(), deltasOfCommand.size());
+				session->setCurIndexInCommHistory(session->getCurIndexInCommHistory() + 1);
+			}
+			deltasOfCommand.clear();
 		}
+		return true;
 	}
 
 public:
-	CommandsManager(Editor* editor) {
-		manager.push(std::pair("Copy", new CopyCommand(editor)));
-		manager.push(std::pair("Paste", new PasteCommand(editor)));
-		manager.push(std::pair("Cut", new CutCommand(editor)));
-		manager.push(std::pair("Delete", new DeleteCommand(editor)));
-		manager.push(std::pair("Undo", new UndoCommand()));
-		manager.push(std::pair("Redo", new RedoCommand()));
-	}
-	~CommandsManager() {
-		while (!manager.empty())
-		{
-			delete manager.top().second;
-			manager.pop();
-		}
-	}
+	CommandsManager(Editor* editor) { this->editor = editor; }
 
 	bool isThereAnyCommandForward() {
 		return Editor::getCurrentSession()->sizeOfCommandsHistory() != 0 &&
 			Editor::getCurrentSession()->getCurIndexInCommHistory() < Editor::getCurrentSession()->sizeOfCommandsHistory() - 1;
 	}
-	void invokeCommand(std::string typeOfCommand, int startPosition = 0, int endPosition = 0, std::string textToPaste = "") {
-
-		deleteForwardCommandsIfNecessary(typeOfCommand);
-		setParametersForCommand(typeOfCommand, startPosition, endPosition, textToPaste);
-
-		getCommandFromManagerByKey(typeOfCommand)->execute();
+	//заміни вже знайдені заздалегідь, тож команда лише застосовує їх і потрапляє в історію одним записом
+	void invokeReplaceAll(std::vector<TextDelta> deltas) {
+		deltasOfCommand = std::move(deltas);
+		invokeCommand(CommandType::ReplaceAll);
+	}
+	//вставка тексту перед символом з позицією position (або в кінець, якщо позиція дорівнює розміру тексту)
+	void invokeInsertion(size_t position, std::string textToInsert) {
+		deltasOfCommand.assign(1, { position, "", std::move(textToInsert) });
+		invokeCommand(CommandType::Paste);
+	}
+	bool invokeCommand(CommandType type, int startPosition = 0, int endPosition = 0, std::string textToPaste = "") {
+		if (startPosition > endPosition && endPosition > -1 && startPosition < Editor::getCurrentText()->size())
+			std::swap(startPosition, endPosition);
 
-		if (isNotUndoOrRedoCommand(typeOfCommand) && typeOfCommand != "Copy")
-			Editor::getCurrentSession()->addCommandAsLast(getCommandFromManagerByKey(typeOfCommand)->copy());
+		if (startPosition == -1 && endPosition == -1) {
+			startPosition = 0;
+			endPosition = 0;
+		}
+		Editor::getCurrentSession()->markChanged();
 
-		if(typeOfCommand == "Undo")
-			Editor::getCurrentSession()->setCurIndexInCommHistory(Editor::getCurrentSession()->getCurIndexInCommHistory() - 1);
-		else
-			if (typeOfCommand != "Copy")
-				Editor::getCurrentSession()->setCurIndexInCommHistory(Editor::getCurrentSession()->getCurIndexInCommHistory() + 1);
+		bool isApplied = false;
+		{
+			ScopedLatency latency((MeasuredOperation)type);
+			switch (type)
+			{
+			case CommandType::Copy: isApplied = execute<CommandType::Copy>(startPosition, endPosition, textToPaste); break;
+			case CommandType::Paste: isApplied = execute<CommandType::Paste>(startPosition, endPosition, textToPaste); break;
+			case CommandType::Cut: isApplied = execute<CommandType::Cut>(startPosition, endPosition, textToPaste); break;
+			case CommandType::Delete: isApplied = execute<CommandType::Delete>(startPosition, endPosition, textToPaste); break;
+			case CommandType::ReplaceAll: isApplied = execute<CommandType::ReplaceAll>(startPosition, endPosition, textToPaste); break;
+			case CommandType::Undo: isApplied = execute<CommandType::Undo>(startPosition, endPosition, textToPaste); break;
+			case CommandType::Redo: isApplied = execute<CommandType::Redo>(startPosition, endPosition, textToPaste); break;
+			}
+		}
+		Metrics::accountSession(Editor::getCurrentSession(), Editor::getCurrentText());
+		return isApplied;
 	}
 };
 
@@ -673,9 +4723,11 @@ class Program {
 private:
 	Editor* editor; //редактор
 	CommandsManager* commandsManager; //менеджер команд, за допомогою якого й викликаються усі команди
+	SessionsAutosaver* autosaver; //фоновий запис змінених текстів сеансів
+	MetricsReporter* metricsReporter; //фоновий запис звіту метрик
 
-	bool validateEnteredNumber(std::string option, short firstOption, short lastOption) {
-		if (option.empty())
+	bool validateEnteredNumber(std::string option, int firstOption, int lastOption) {
+		if (option.empty() || option.size() > 9)
 			return false;
 
 		for (char num : option)
@@ -701,13 +4753,14 @@ private:
 		return isOptionVerified ? stoi(option) : -1;
 	}
 	void readDataFromFile() {
+		autosaver->flush();
 		std::string filepath = FilesManager::getSessionsDirectory() + editor->getCurrentSession()->getName();
-		std::string textFromFile = FilesManager::readSessionData(filepath);
-		editor->setCurrentText(new std::string(textFromFile));
+		editor->setCurrentText(FilesManager::readSessionText(filepath));
+		Metrics::accountSessions(editor->getSessionsHistory(), editor->getCurrentSession(), editor->getCurrentText());
 	}
 	void pauseAndCleanConsole() {
-		system("pause");
-		system("cls");
+		ConsoleRenderer::waitForKey();
+		ConsoleRenderer::beginFrame();
 	}
 	void printNotification(std::string type, std::string msg) {
 		if (type == "success")
@@ -723,14 +4776,14 @@ private:
 		std::cout << "\nПомилка: " << msg << "\n\n";
 	}
 	void printReference() {
-		system("cls");
+		ConsoleRenderer::beginFrame();
 		std::cout << "Розробив: Бредун Денис Сергійович з групи ПЗ-21-1/9\n\n";
 		std::cout << "Застосунок дозволяє працювати з текстовими файлами створюючи, редагуючи та видаляючи їх зміст\n";
 		std::cout << "за допомогою команд Вставити, Вирізати, Копіювати, Видалити. Також можна повертатись до минулого стану\n";
 		std::cout << "файлу за допомогою команди Скасувати та повторити останню команду за допомогою команди Повторити.\n\n";
 		std::cout << "Використаний патерн проектування: Команда.\n";
 		std::cout << "Використаний контейнер: стек.\n";
-		system("pause");
+		ConsoleRenderer::waitForKey();
 	}
 
 	void templateForMenusAboutSessions(int& choice, std::string action) {
@@ -741,7 +4794,8 @@ private:
 		std::cout << "3. За позицією\n";
 		std::cout << "4. За іменем\n";
 		std::cout << "5. Відсортувати сеанси за іменем\n";
-		choice = enterNumberInRange("Ваш вибір: ", 0, 5);
+		std::cout << "6. Знайти сеанси за початком імені\n";
+		choice = enterNumberInRange("Ваш вибір: ", 0, 6);
 	}
 	void templateForExecutingMenusAboutSessions(std::function<void(int&)> mainFunc, std::function<void(int&)> menu,
 		std::function<bool()> actionFuncByName, std::function<void()> additionalFunc = nullptr) {
@@ -757,7 +4811,7 @@ private:
 			case -1: continue;
 			case 0:
 				std::cout << "\nПовернення до Головного меню.\n\n";
-				system("pause");
+				ConsoleRenderer::waitForKey();
 				return;
 			default:
 				if (doesAnySessionExist())
@@ -779,12 +4833,41 @@ private:
 						continue;
 					case 5:
 						sortSessions();
+						continue;
+					case 6:
+						printSessionsByPrefix();
 					}
 				}
 			}
 		} while (true);
 	}
 
+	//текст для вставки чи пошуку перетворюється в кодування поточного тексту. Кодування введення визначається джерелом, а не вгадується
+	//за байтами: з консолі - завжди Windows-1251, зі сценарію - завжди UTF-8 (багато пар кириличних байтів Windows-1251 є коректним UTF-8)
+	std::string toEncodingOfCurrentText(std::string text, TextEncoding encodingOfInput) {
+		TextEncoding encodingOfText = editor->getCurrentText()->getEncoding();
+		if (encodingOfInput == encodingOfText)
+			return text;
+		return encodingOfText == TextEncoding::Utf8 ? Cp1251::toUtf8(text) : Cp1251::fromUtf8(text);
+	}
+	//у тексті UTF-8 позиції рахуються символами: початок символу з даним номером або false, якщо символу немає
+	bool convertCodepointToPosition(size_t& position, bool isEndOfTextAllowed) {
+		TextBuffer* currentText = editor->getCurrentText();
+		if (currentText->getEncoding() != TextEncoding::Utf8)
+			return true;
+		if (position > currentText->countOfCodepoints() || (!isEndOfTextAllowed && position == currentText->countOfCodepoints()))
+			return false;
+		position = currentText->offsetOfCodepoint(position);
+		return true;
+	}
+	//останній байт символу, що починається в position: кінець діапазону включно не повинен розрізати символ UTF-8
+	size_t getLastByteOfCharacter(size_t position) {
+		TextBuffer* currentText = editor->getCurrentText();
+		if (currentText->getEncoding() != TextEncoding::Utf8)
+			return position;
+		return currentText->offsetOfCodepoint(currentText->codepointOfOffset(position) + 1) - 1;
+	}
+
 	std::string getTextUsingKeyboard() {
 		std::string line, text;
 		int countOfLines = 0;
@@ -805,7 +4888,7 @@ private:
 			}
 		}
 
-		return text;
+		return toEncodingOfCurrentText(text, TextEncoding::Cp1251);
 	}
 	std::string getTextFromClipboard() {
 		if (editor->getCurrentSession()->sizeOfClipboard() == 0) {
@@ -815,14 +4898,14 @@ private:
 
 		int choice, sizeOfClipboard = editor->getCurrentSession()->sizeOfClipboard();
 
-		editor->getCurrentSession()->printClipboard();
+		editor->getCurrentSession()->printClipboard(editor->getCurrentText()->getEncoding());
 		getTextFromClipboardMenu(choice);
 
 		switch (choice)
 		{
 		case 0:
 			std::cout << "\nПовернення до меню вибору способа додавання текста.\n\n";
-			system("pause");
+			ConsoleRenderer::waitForKey();
 			return "";
 		case 1:
 			return editor->getCurrentSession()->getDataFromClipboardByIndex(sizeOfClipboard - 1);
@@ -838,7 +4921,106 @@ private:
 		}
 	}
 
-	bool makeActionOnContextByEnteredText(std::string typeOfCommand, std::string actionInPast,
+	//рядок і стовпець нумеруються з 1; стовпець за останнім символом рядка - це його символ нового рядка
+	//(або кінець тексту, якщо isEndOfTextAllowed)
+	bool convertLineAndColumnToPosition(std::string lineAndColumn, size_t& position, bool isEndOfTextAllowed) {
+		TextBuffer* currentText = editor->getCurrentText();
+		size_t positionOfColon = lineAndColumn.find(':');
+		if (positionOfColon == std::string::npos)
+			return false;
+
+		std::string line = lineAndColumn.substr(0, positionOfColon), column = lineAndColumn.substr(positionOfColon + 1);
+		if (line.empty() || column.empty() || line.size() > 18 || column.size() > 18 ||
+			line.find_first_not_of("0123456789") != std::string::npos || column.find_first_not_of("0123456789") != std::string::npos)
+			return false;
+
+		size_t numberOfLine = std::stoull(line), numberOfColumn = std::stoull(column);
+		if (numberOfLine == 0 || numberOfColumn == 0 || numberOfLine > currentText->countOfLines())
+			return false;
+
+		size_t startOfLine = currentText->offsetOfLine(numberOfLine - 1), lengthOfLine = currentText->lengthOfLine(numberOfLine - 1);
+		if (currentText->getEncoding() == TextEncoding::Utf8) {
+			//стовпці рядка в UTF-8 - це символи, а не байти
+			size_t firstCodepoint = currentText->codepointOfOffset(startOfLine);
+			if (numberOfColumn > currentText->codepointOfOffset(startOfLine + lengthOfLine) - firstCodepoint + 1)
+				return false;
+			position = currentText->offsetOfCodepoint(firstCodepoint + numberOfColumn - 1);
+		}
+		else {
+			if (numberOfColumn > lengthOfLine + 1)
+				return false;
+			position = startOfLine + numberOfColumn - 1;
+		}
+		return position < currentText->size() || (isEndOfTextAllowed && position == currentText->size());
+	}
+	bool enterLineAndColumn(std::string message, size_t& position, bool isEndOfTextAllowed) {
+		std::string lineAndColumn;
+
+		std::cout << "\n" << message;
+		getline(std::cin, lineAndColumn);
+
+		if (!convertLineAndColumnToPosition(lineAndColumn, position, isEndOfTextAllowed)) {
+			printNotification("error", "позиція має бути у вигляді рядок:стовпець і не виходити за межі тексту!");
+			return false;
+		}
+		return true;
+	}
+	//вставка в будь-яку позицію, зокрема на початок і в кінець, не зачіпає сусідніх символів
+	void invokeInsertion(size_t position, std::string textToPaste) {
+		commandsManager->invokeInsertion(position, std::move(textToPaste));
+	}
+	//дія над кількома входженнями - одна команда з кількома змінами, як і заміна кількох фрагментів: один запис в історії
+	//та журналі, і одне скасування повертає всі входження. Входження, що перекриваються з попереднім, пропускаються
+	void invokeCommandForOccurrences(CommandType typeOfCommand, const std::vector<size_t>& occurrences, const std::string& foundText, const std::string& textToPaste) {
+		if (occurrences.size() == 1 || typeOfCommand == CommandType::Copy) {
+			//з кінця до початку, як і раніше: копії потрапляють до буфера обміну в тому ж порядку
+			for (auto occurrence = occurrences.rbegin(); occurrence != occurrences.rend(); occurrence++)
+				commandsManager->invokeCommand(typeOfCommand, *occurrence, getEndIndexOfFoundText(typeOfCommand, *occurrence, foundText.size()), textToPaste);
+			return;
+		}
+
+		std::vector<TextDelta> deltas;
+		for (size_t occurrence : occurrences)
+			if (deltas.empty() || occurrence >= deltas.back().position + foundText.size())
+				deltas.push_back({ occurrence, foundText, typeOfCommand == CommandType::Paste ? textToPaste : "" });
+
+		if (typeOfCommand == CommandType::Cut)
+			for (auto delta = deltas.rbegin(); delta != deltas.rend(); delta++)
+				editor->copy(editor->getCurrentText(), delta->position, delta->position + foundText.size() - 1);
+		commandsManager->invokeReplaceAll(std::move(deltas));
+	}
+	size_t getEndIndexOfFoundText(CommandType typeOfCommand, size_t startIndex, size_t sizeOfFoundText) {
+		if (typeOfCommand == CommandType::Paste) {
+			if (startIndex == 0 && sizeOfFoundText == 1)
+				return -1;
+			else if (startIndex == editor->getCurrentText()->size() - 1 && sizeOfFoundText == 1)
+				return editor->getCurrentText()->size();
+			else
+				return startIndex + sizeOfFoundText - 1;
+		}
+		else {
+			if (sizeOfFoundText == 1)
+				return startIndex;
+			else
+				return startIndex + sizeOfFoundText - 1;
+		}
+	}
+	//якщо текст зустрічається декілька разів, користувач обирає, яке входження обробити, або всі одразу
+	bool chooseOccurrences(std::vector<size_t>& occurrences) {
+		if (occurrences.size() == 1)
+			return true;
+
+		std::cout << "\nТекст зустрічається " << occurrences.size() << " разів.";
+		int number = enterNumberInRange("Введіть номер входження (0 - усі входження): ", 0, occurrences.size());
+		if (number == -1)
+			return false;
+
+		if (number > 0)
+			occurrences = { occurrences[number - 1] };
+		return true;
+	}
+
+	bool makeActionOnContextByEnteredText(CommandType typeOfCommand, std::string actionInPast,
 		std::string textToPaste = "", size_t startIndex = -2, size_t endIndex = -2) {
 		if (startIndex == -2 && endIndex == -2) {
 			if (editor->getCurrentText()->empty()) {
@@ -855,38 +5037,65 @@ private:
 				return false;
 			}
 
-			startIndex = editor->getCurrentText()->find(textForAction);
+			std::vector<size_t> occurrences = TextSearcher::findAll(editor->getCurrentText(), textForAction);
 
-			if (startIndex == std::string::npos) {
+			if (occurrences.empty()) {
 				printNotification("error", "текст не був знайдений!");
 				return false;
 			}
 
-			if (typeOfCommand == "Paste") {
-				if (startIndex == 0 && textForAction.size() == 1)
-					endIndex = -1;
-				else if (startIndex == editor->getCurrentText()->size() - 1 && textForAction.size() == 1)
-					endIndex = editor->getCurrentText()->size();
-				else
-					endIndex = startIndex + textForAction.size() - 1;
-			}
-			else {
-				if (textForAction.size() == 1)
-					endIndex = startIndex;
-				else
-					endIndex = startIndex + textForAction.size() - 1;
-			}
+			if (!chooseOccurrences(occurrences))
+				return false;
+
+			invokeCommandForOccurrences(typeOfCommand, occurrences, textForAction, textToPaste);
 		}
+		else
+			commandsManager->invokeCommand(typeOfCommand, startIndex, endIndex, textToPaste);
 
-		commandsManager->invokeCommand(typeOfCommand, startIndex, endIndex, textToPaste);
 		printNotification("success", "дані були успішно " + actionInPast + "!");
 		return true;
 	}
 
+	bool executeReplacingSeveralFragments() {
+		std::vector<std::pair<std::string, std::string>> replacements;
+		std::string line;
+		const std::string separator = "=>";
+
+		editor->printCurrentText();
+		std::cout << "\nВведіть заміни, кожну з нового рядка, у вигляді \"що замінити" << separator << "на що замінити\"";
+		std::cout << "\n(зупинити - з наступного рядка введіть \"-1\"): \n";
+		while (getline(std::cin, line) && line != "-1") {
+			size_t positionOfSeparator = line.find(separator);
+			if (positionOfSeparator == std::string::npos || positionOfSeparator == 0) {
+				std::cout << "Рядок пропущено: немає \"" << separator << "\" або тексту перед ним.\n";
+				continue;
+			}
+			replacements.push_back({ toEncodingOfCurrentText(line.substr(0, positionOfSeparator), TextEncoding::Cp1251),
+				toEncodingOfCurrentText(line.substr(positionOfSeparator + separator.size()), TextEncoding::Cp1251) });
+		}
+
+		if (replacements.empty()) {
+			printNotification("error", "заміни не були введені!");
+			return false;
+		}
+
+		std::vector<TextDelta> deltas = editor->findReplacements(editor->getCurrentText(), replacements);
+		if (deltas.empty()) {
+			printNotification("error", "жоден з фрагментів не був знайдений!");
+			return false;
+		}
+
+		commandsManager->invokeReplaceAll(deltas);
+		printNotification("success", "було виконано замін: " + std::to_string(deltas.size()) + "!");
+		return true;
+	}
 	bool undoAction() {
 		if (editor->getCurrentSession()->sizeOfCommandsHistory() > 0 && editor->getCurrentSession()->getCurIndexInCommHistory() != -1)
 		{
-			commandsManager->invokeCommand("Undo");
+			if (!commandsManager->invokeCommand(CommandType::Undo)) {
+				printNotification("error", "запис історії не вдалося прочитати, тож команду не можна скасувати!");
+				return false;
+			}
 			printNotification("success", "команда була успішно скасована!");
 			return true;
 		}
@@ -897,7 +5106,10 @@ private:
 		bool isThereAnyCommandForward = commandsManager->isThereAnyCommandForward();
 		if (isThereAnyCommandForward)
 		{
-			commandsManager->invokeCommand("Redo");
+			if (!commandsManager->invokeCommand(CommandType::Redo)) {
+				printNotification("error", "запис історії не вдалося прочитати, тож команду не можна повторити!");
+				return false;
+			}
 			printNotification("success", "команда була успішно повторена!");
 
 		}
@@ -909,6 +5121,24 @@ private:
 		editor->getSessionsHistory()->sortByName();
 		printNotification("success", "сеанси були успішно відсортовані!");
 	}
+	void printSessionsByPrefix() {
+		std::string prefix;
+
+		std::cout << "\nВведіть початок імені сеансу: ";
+		getline(std::cin, prefix);
+
+		std::vector<Session*> sessions = editor->getSessionsHistory()->getSessionsByPrefix(prefix);
+		if (sessions.empty()) {
+			printNotification("error", "сеансів з таким початком імені немає!");
+			return;
+		}
+
+		ConsoleRenderer::beginFrame();
+		for (Session* session : sessions)
+			std::cout << "\n" << session->getName();
+		std::cout << "\n\n";
+		ConsoleRenderer::waitForKey();
+	}
 
 	void wayToGetTextForAddingMenu(int& choice) {
 		std::cout << "\nЯк ви хочете додати текст:\n";
@@ -931,14 +5161,16 @@ private:
 		std::cout << "1. В кінець\n";
 		std::cout << "2. На початок\n";
 		std::cout << "3. Ввести з клавіатури текст, який хочете замінити\n";
-		choice = enterNumberInRange("Ваш вибір: ", 0, 3);
+		std::cout << "4. У позицію рядок:стовпець\n";
+		choice = enterNumberInRange("Ваш вибір: ", 0, 4);
 	}
 	void delCopyOrCutTextMenu(int& choice, std::string action) {
 		std::cout << "\nСкільки хочете " << action << ":\n";
 		std::cout << "0. Назад\n";
 		std::cout << "1. Весь зміст\n";
 		std::cout << "2. Введу з клавіатури, що " << action << "\n";
-		choice = enterNumberInRange("Ваш вибір: ", 0, 2);
+		std::cout << "3. Вкажу діапазон рядок:стовпець - рядок:стовпець\n";
+		choice = enterNumberInRange("Ваш вибір: ", 0, 3);
 	}
 	void makeActionsOnContentMenu(int& choice) {
 		std::cout << "\nМеню дій над змістом:\n";
@@ -949,7 +5181,17 @@ private:
 		std::cout << "4. Вирізати текст\n";
 		std::cout << "5. Скасувати команду\n";
 		std::cout << "6. Повторити команду\n";
-		choice = enterNumberInRange("Ваш вибір: ", 0, 6);
+		std::cout << "7. Замінити декілька фрагментів одразу\n";
+		std::cout << "8. Переглянути текст сторінками з номерами рядків\n";
+		choice = enterNumberInRange("Ваш вибір: ", 0, 8);
+	}
+	void viewingTextByPagesMenu(int& choice) {
+		std::cout << "\nПерегляд сторінками:\n";
+		std::cout << "0. Назад\n";
+		std::cout << "1. Наступна сторінка\n";
+		std::cout << "2. Попередня сторінка\n";
+		std::cout << "3. Перейти до рядка\n";
+		choice = enterNumberInRange("Ваш вибір: ", 0, 3);
 	}
 	void printGettingSessionsMenu(int& choice) {
 		templateForMenusAboutSessions(choice, "отримати");
@@ -958,14 +5200,16 @@ private:
 		templateForMenusAboutSessions(choice, "видалити");
 	}
 	void printManagingSessionsMenu(int& choice) {
-		system("cls");
+		ConsoleRenderer::beginFrame();
 		std::cout << "Головне меню:\n";
 		std::cout << "0. Закрити програму\n";
 		std::cout << "1. Довідка\n";
 		std::cout << "2. Створити сеанс\n";
 		std::cout << "3. Відкрити сеанс\n";
 		std::cout << "4. Видалити сеанс\n";
-		choice = enterNumberInRange("Ваш вибір: ", 0, 4);
+		std::cout << "5. Шукати текст в усіх сеансах\n";
+		std::cout << "6. Статистика\n";
+		choice = enterNumberInRange("Ваш вибір: ", 0, 6);
 	}
 
 	std::string executeGettingTextForAdding() {
@@ -980,7 +5224,7 @@ private:
 			{
 			case 0:
 				std::cout << "\nПовернення до Меню дій над змістом.\n\n";
-				system("pause");
+				ConsoleRenderer::waitForKey();
 				return "";
 			case 1:
 			case 2:
@@ -1005,20 +5249,65 @@ private:
 			switch (choice) {
 			case 0:
 				std::cout << "\nПовернення до Меню дій над змістом.\n\n";
-				system("pause");
+				ConsoleRenderer::waitForKey();
 				return false;
 			case 1:
-				makeActionOnContextByEnteredText("Paste", "вставлені", textToPaste, editor->getCurrentText()->size() - 1, editor->getCurrentText()->size() - 1);
-				return true;
 			case 2:
-				makeActionOnContextByEnteredText("Paste", "вставлені", textToPaste, 0, 0);
+				invokeInsertion(choice == 1 ? editor->getCurrentText()->size() : 0, textToPaste);
+				printNotification("success", "дані були успішно вставлені!");
 				return true;
 			case 3:
-				if (makeActionOnContextByEnteredText("Paste", "вставлені", textToPaste))
+				if (makeActionOnContextByEnteredText(CommandType::Paste, "вставлені", textToPaste))
+					return true;
+				break;
+			case 4:
+				if (executeInsertingByLineAndColumn(textToPaste))
 					return true;
 			}
 		} while (true);
 	}
+	bool executeInsertingByLineAndColumn(std::string textToPaste) {
+		size_t position;
+		if (!enterLineAndColumn("Введіть позицію для вставки (рядок:стовпець): ", position, true))
+			return false;
+
+		invokeInsertion(position, textToPaste);
+		printNotification("success", "дані були успішно вставлені!");
+		return true;
+	}
+	void executeViewingTextByPages() {
+		const size_t ROWS_RESERVED_FOR_MENU = 14, LINES_ON_PAGE_WITHOUT_CONSOLE = 20;
+		size_t firstLine = 0;
+		int choice;
+
+		do {
+			size_t countOfLines = editor->getCurrentText()->countOfLines();
+			size_t countOfLinesOnPage = ConsoleRenderer::getCountOfFreeRows(ROWS_RESERVED_FOR_MENU);
+			if (countOfLinesOnPage == 0)
+				countOfLinesOnPage = LINES_ON_PAGE_WITHOUT_CONSOLE;
+
+			editor->printPageOfCurrentText(firstLine, countOfLinesOnPage);
+			viewingTextByPagesMenu(choice);
+
+			switch (choice) {
+			case 0:
+				std::cout << "\nПовернення до Меню дій над змістом.\n\n";
+				ConsoleRenderer::waitForKey();
+				return;
+			case 1:
+				if (firstLine + countOfLinesOnPage < countOfLines)
+					firstLine += countOfLinesOnPage;
+				break;
+			case 2:
+				firstLine -= std::min(firstLine, countOfLinesOnPage);
+				break;
+			case 3:
+				choice = enterNumberInRange("Введіть номер рядка: ", 1, countOfLines);
+				if (choice != -1)
+					firstLine = choice - 1;
+			}
+		} while (true);
+	}
 	void executeMakeActionsOnContentMenu() {
 		commandsManager = new CommandsManager(editor);
 		bool wasTextSuccessfullyChanged;
@@ -1036,8 +5325,12 @@ private:
 			{
 			case 0:
 				std::cout << "\nПовернення до Меню для отримання сеансу.\n\n";
-				system("pause");
+				ConsoleRenderer::waitForKey();
 				delete (commandsManager);
+				//автозбереження працює з власною копією тексту, тож текст (разом з відображеним файлом) можна звільнити одразу
+				delete editor->getCurrentText();
+				editor->setCurrentText(nullptr);
+				Metrics::accountSession(editor->getCurrentSession(), nullptr);
 				return;
 			case 1:
 				wasTextSuccessfullyChanged = executeAddingTextToFile();
@@ -1056,9 +5349,15 @@ private:
 				break;
 			case 6:
 				wasTextSuccessfullyChanged = redoAction();
+				break;
+			case 7:
+				wasTextSuccessfullyChanged = executeReplacingSeveralFragments();
+				break;
+			case 8:
+				executeViewingTextByPages();
 			}
 			if (wasTextSuccessfullyChanged)
-				FilesManager::writeSessionData(editor->getCurrentSession()->getName(), *(editor->getCurrentText()));
+				autosaver->schedule(editor->getCurrentSession()->getName(), editor->getCurrentText());
 		} while (true);
 	}
 	void executeDeletingSessionsMenu() {
@@ -1090,7 +5389,7 @@ private:
 
 		templateForExecutingMenusAboutSessions(mainFunc, menu, actionFuncByName, additionalFunc);
 	}
-	bool executeDelCopyOrCutText(std::string typeOfCommand, std::string actionForMenu, std::string actionInPast) {
+	bool executeDelCopyOrCutText(CommandType typeOfCommand, std::string actionForMenu, std::string actionInPast) {
 		int choice;
 		bool wasOperationSuccessful = false;
 
@@ -1101,7 +5400,7 @@ private:
 		{
 		case 0:
 			std::cout << "\nПовернення до Меню дій над змістом.\n\n";
-			system("pause");
+			ConsoleRenderer::waitForKey();
 			return false;
 		case 1:
 			wasOperationSuccessful = makeActionOnContextByEnteredText(typeOfCommand, actionInPast, "", 0, editor->getCurrentText()->size() - 1);
@@ -1109,6 +5408,16 @@ private:
 		case 2:
 			wasOperationSuccessful = makeActionOnContextByEnteredText(typeOfCommand, actionInPast);
 			return wasOperationSuccessful;
+		case 3:
+			size_t startPosition, endPosition;
+			if (!enterLineAndColumn("Введіть початок (рядок:стовпець): ", startPosition, false) ||
+				!enterLineAndColumn("Введіть кінець включно (рядок:стовпець): ", endPosition, false))
+				return false;
+			if (startPosition > endPosition) {
+				printNotification("error", "початок діапазону стоїть після його кінця!");
+				return false;
+			}
+			return makeActionOnContextByEnteredText(typeOfCommand, actionInPast, "", startPosition, getLastByteOfCharacter(endPosition));
 		}
 	}
 	bool chooseRootDelCopyOrCut(std::string action) {
@@ -1120,11 +5429,11 @@ private:
 		else
 		{
 			if (action == "видалити")
-				return executeDelCopyOrCutText("Delete", action, "видалені");
+				return executeDelCopyOrCutText(CommandType::Delete, action, "видалені");
 			else if (action == "скопіювати")
-				return executeDelCopyOrCutText("Copy", action, "скопійовані");
+				return executeDelCopyOrCutText(CommandType::Copy, action, "скопійовані");
 			else
-				return executeDelCopyOrCutText("Cut", action, "вирізані");
+				return executeDelCopyOrCutText(CommandType::Cut, action, "вирізані");
 		}
 	}
 
@@ -1142,6 +5451,58 @@ private:
 		return !editor->getSessionsHistory()->isEmpty();
 	}
 
+	//входження друкуються одразу, як знайдені, а пошук зупиняється, щойно показано задану кількість
+	void executeSearchingInAllSessions() {
+		std::string pattern;
+
+		std::cout << "\nВведіть текст для пошуку: ";
+		getline(std::cin, pattern);
+		if (pattern.empty()) {
+			printNotification("error", "текст для пошуку не може бути порожнім!");
+			return;
+		}
+
+		int maxCountOfMatches = enterNumberInRange("Скільки входжень показати (0 - всі): ", 0, 999999999);
+		if (maxCountOfMatches == -1)
+			return;
+
+		autosaver->flush();
+		size_t countOfMatches = 0;
+		std::cout << "\n";
+		FilesManager::searchInSessionsData(pattern, [&countOfMatches, maxCountOfMatches](const SessionsSearcher::Match& match) {
+			std::cout << match.sessionName << " " << match.line << ":" << match.column << " (зміщення " << match.offset << ")\n";
+			return ++countOfMatches != (size_t)maxCountOfMatches;
+			});
+
+		if (countOfMatches == 0)
+			printNotification("error", "текст не знайдено в жодному сеансі!");
+		else
+			printNotification("success", "показано входжень: " + std::to_string(countOfMatches) + "!");
+	}
+	static std::string formatNanoseconds(uint64_t nanoseconds) {
+		return std::to_string(nanoseconds / 1000) + "." + std::to_string(nanoseconds / 100 % 10) + " мкс";
+	}
+	//показуються лише операції, які вже виконувались; облік пам'яті перераховується перед показом
+	void printStatistics() {
+		Metrics::accountSessions(editor->getSessionsHistory(), editor->getCurrentSession(), editor->getCurrentSession() ? editor->getCurrentText() : nullptr);
+
+		std::cout << "\nТривалість операцій (кількість, медіана, 90-й і 99-й перцентилі, максимум):\n";
+		for (size_t i = 0; i < (size_t)MeasuredOperation::Count; i++) {
+			const LatencyHistogram& histogram = Metrics::of((MeasuredOperation)i);
+			if (histogram.getCount() == 0)
+				continue;
+
+			std::cout << Metrics::nameOf((MeasuredOperation)i) << ": " << histogram.getCount() << ", " << formatNanoseconds(histogram.getPercentile(50)) << ", "
+				<< formatNanoseconds(histogram.getPercentile(90)) << ", " << formatNanoseconds(histogram.getPercentile(99)) << ", " << formatNanoseconds(histogram.getMax()) << "\n";
+		}
+
+		std::cout << "\nПам'ять сеансів у байтах (текст, історія, буфер обміну):\n";
+		for (const auto& [name, memory] : Metrics::getMemoryOfSessions())
+			std::cout << name << ": " << memory.textBytes << ", " << memory.historyBytes << ", " << memory.clipboardBytes << "\n";
+		std::cout << "Спільне сховище фрагментів історії: " << FilesManager::getSizeOfSharedHistory() << "\n\n";
+
+		pauseAndCleanConsole();
+	}
 	void createSession() {
 		std::string filename;
 
@@ -1157,13 +5518,7 @@ private:
 				return;
 			}
 
-			if (!std::filesystem::exists(FilesManager::getSessionsDirectory()))
-				std::filesystem::create_directories(FilesManager::getSessionsDirectory());
-
-			std::string filepath = FilesManager::getSessionsDirectory() + newSession->getName();
-			std::ofstream file(filepath);
-			file.close();
-			editor->getSessionsHistory()->addSessionToEnd(newSession);
+			addNewSession(newSession);
 			printNotification("success", "сеанс був успішно створений!");
 		}
 		else
@@ -1172,9 +5527,23 @@ private:
 			printNotification("error", "були введені заборонені символи!");
 		}
 	}
+	void addNewSession(Session* newSession) {
+		if (!std::filesystem::exists(FilesManager::getSessionsDirectory()))
+			std::filesystem::create_directories(FilesManager::getSessionsDirectory());
+
+		std::string filepath = FilesManager::getSessionsDirectory() + newSession->getName();
+		std::ofstream file(filepath);
+		file.close();
+		editor->getSessionsHistory()->addSessionToEnd(newSession);
+		FilesManager::openSessionJournal(newSession);
+	}
+	void selectSession(Session* session) {
+		FilesManager::loadSessionHistory(editor, session);
+		editor->setCurrentSession(session);
+	}
 	void setCurrentSessionByIndex(int& index) {
 		if (tryToEnterIndexForSession(index))
-			editor->setCurrentSession(editor->getSessionsHistory()->getSessionByIndex(index - 1));
+			selectSession(editor->getSessionsHistory()->getSessionByIndex(index - 1));
 	}
 	bool setCurrentSessionByName() {
 		std::string name;
@@ -1184,14 +5553,16 @@ private:
 		if (session == nullptr)
 			printNotification("error", "сеанса з таким іменем не існує!");
 		else
-			editor->setCurrentSession(session);
+			selectSession(session);
 		return session != nullptr;
 	}
 	void deleteSessionByIndex(int index = -1) {
 		if (tryToEnterIndexForSession(index)) {
+			autosaver->flush();
 			std::string nameOfSession = editor->getSessionsHistory()->deleteSessionByIndex(index - 1);
 			std::string pathToSession = FilesManager::getSessionsDirectory() + nameOfSession;
 			remove(pathToSession.c_str());
+			FilesManager::deleteSessionJournal(nameOfSession);
 
 			printNotification("success", "сеанс був успішно видалений!");
 		}
@@ -1200,6 +5571,7 @@ private:
 		std::string name;
 		std::cout << "\nВведіть ім'я сеансу: ";
 		getline(std::cin, name);
+		autosaver->flush();
 		auto filename = editor->getSessionsHistory()->deleteSessionByName(name);
 		if (filename.empty())
 		{
@@ -1208,16 +5580,276 @@ private:
 		}
 		std::string pathToSession = FilesManager::getSessionsDirectory() + filename;
 		remove(pathToSession.c_str());
+		FilesManager::deleteSessionJournal(filename);
 
 		printNotification("success", "сеанс був успішно видалений!");
 		return true;
 	}
+
+	//далі - пакетний режим: сценарій виконується рядок за рядком без меню, пауз і очищення консолі,
+	//а весь вивід накопичується і друкується одним блоком в кінці
+	std::string takeScriptToken(std::string& arguments) {
+		size_t start = arguments.find_first_not_of(' ');
+		if (start == std::string::npos) {
+			arguments.clear();
+			return "";
+		}
+
+		size_t end = arguments.find(' ', start);
+		std::string token = arguments.substr(start, end - start);
+		arguments = end == std::string::npos ? "" : arguments.substr(end + 1);
+		return token;
+	}
+	bool takeScriptNumber(std::string& arguments, size_t& number) {
+		std::string token = takeScriptToken(arguments);
+		if (token.empty() || token.size() > 18 || token.find_first_not_of("0123456789") != std::string::npos)
+			return false;
+
+		number = std::stoull(token);
+		return true;
+	}
+	//позиція - або зміщення (в байтах, а в тексті UTF-8 - в символах), або рядок:стовпець
+	bool takeScriptPosition(std::string& arguments, size_t& position, bool isEndOfTextAllowed) {
+		std::string token = takeScriptToken(arguments);
+		if (token.find(':') != std::string::npos)
+			return convertLineAndColumnToPosition(token, position, isEndOfTextAllowed);
+
+		arguments = token + " " + arguments;
+		return takeScriptNumber(arguments, position) && convertCodepointToPosition(position, isEndOfTextAllowed);
+	}
+	//номер входження (з 1) або "*" - усі входження; 0 означає усі
+	bool takeScriptOccurrenceNumber(std::string& arguments, size_t& number) {
+		if (arguments.compare(0, 2, "* ") == 0) {
+			arguments.erase(0, 2);
+			number = 0;
+			return true;
+		}
+		return takeScriptNumber(arguments, number) && number > 0;
+	}
+	//у тексті сценарію \n - новий рядок, \t - табуляція, \\ - зворотна коса риска
+	std::string decodeScriptText(const std::string& text) {
+		std::string decoded;
+		for (size_t i = 0; i < text.size(); i++) {
+			if (text[i] != '\\' || i + 1 == text.size()) {
+				decoded += text[i];
+				continue;
+			}
+			char escaped = text[++i];
+			decoded += escaped == 'n' ? '\n' : escaped == 't' ? '\t' : escaped;
+		}
+		return decoded;
+	}
+	void saveScriptSessionIfChanged(bool& isTextChanged) {
+		if (isTextChanged)
+			autosaver->schedule(editor->getCurrentSession()->getName(), editor->getCurrentText());
+		isTextChanged = false;
+	}
+	std::string openSessionFromScript(std::string name, bool shouldCreate) {
+		Session* session = editor->getSessionsHistory()->getSessionByName(name);
+
+		if (shouldCreate) {
+			if (session != nullptr)
+				return "сеанс з таким іменем вже існує!";
+
+			session = new Session();
+			if (!session->setName(name)) {
+				delete session;
+				return "були введені заборонені символи!";
+			}
+			addNewSession(session);
+		}
+		else if (session == nullptr)
+			return "сеанса з таким іменем не існує!";
+
+		selectSession(session);
+		delete editor->getCurrentText();
+		readDataFromFile();
+		return "";
+	}
+	std::string executeScriptActionByMatch(CommandType typeOfCommand, std::string arguments) {
+		size_t number;
+		if (!takeScriptOccurrenceNumber(arguments, number))
+			return "невірний номер входження!";
+
+		std::string textToPaste;
+		if (typeOfCommand == CommandType::Paste) {
+			size_t positionOfSeparator = arguments.find("=>");
+			if (positionOfSeparator == std::string::npos)
+				return "немає \"=>\" між шуканим текстом і текстом для вставки!";
+			textToPaste = toEncodingOfCurrentText(decodeScriptText(arguments.substr(positionOfSeparator + 2)), TextEncoding::Utf8);
+			arguments.erase(positionOfSeparator);
+		}
+
+		std::string textForAction = toEncodingOfCurrentText(decodeScriptText(arguments), TextEncoding::Utf8);
+		if (textForAction.empty())
+			return "текст не був введений!";
+
+		std::vector<size_t> occurrences = TextSearcher::findAll(editor->getCurrentText(), textForAction);
+		if (occurrences.size() < number || occurrences.empty())
+			return "текст не був знайдений!";
+		if (number > 0)
+			occurrences = { occurrences[number - 1] };
+
+		invokeCommandForOccurrences(typeOfCommand, occurrences, textForAction, textToPaste);
+		return "";
+	}
+	std::string executeScriptActionByPositions(CommandType typeOfCommand, std::string arguments) {
+		size_t startPosition, endPosition;
+		if (!takeScriptPosition(arguments, startPosition, false) || !takeScriptPosition(arguments, endPosition, false))
+			return "позиції мають бути невід'ємними числами або парами рядок:стовпець у межах тексту!";
+		if (startPosition > endPosition || endPosition >= editor->getCurrentText()->size())
+			return "позиції виходять за межі тексту!";
+
+		commandsManager->invokeCommand(typeOfCommand, startPosition, getLastByteOfCharacter(endPosition));
+		return "";
+	}
+	std::string executeScriptInsertion(std::string arguments) {
+		size_t position;
+		if (!takeScriptPosition(arguments, position, true))
+			return "позиція має бути невід'ємним числом або парою рядок:стовпець у межах тексту!";
+		if (position > editor->getCurrentText()->size())
+			return "позиція виходить за межі тексту!";
+
+		std::string textToPaste = toEncodingOfCurrentText(decodeScriptText(arguments), TextEncoding::Utf8);
+		if (textToPaste.empty())
+			return "текст не був введений!";
+
+		invokeInsertion(position, textToPaste);
+		return "";
+	}
+	//повертає опис помилки або порожній рядок, якщо операція виконана
+	std::string executeScriptSearch(std::string pattern, std::string& output) {
+		if (pattern.empty())
+			return "текст для пошуку не може бути порожнім!";
+
+		FilesManager::searchInSessionsData(pattern, [&output](const SessionsSearcher::Match& match) {
+			output += match.sessionName + " " + std::to_string(match.line) + ":" + std::to_string(match.column) +
+				" (зміщення " + std::to_string(match.offset) + ")\n";
+			return true;
+			});
+		return "";
+	}
+	std::string executeScriptOperation(std::string operation, std::string arguments, bool& isTextChanged, std::string& output) {
+		if (operation == "create" || operation == "open") {
+			if (editor->getCurrentSession() != nullptr)
+				saveScriptSessionIfChanged(isTextChanged);
+			return openSessionFromScript(arguments, operation == "create");
+		}
+		if (operation == "search") {
+			if (editor->getCurrentSession() != nullptr)
+				saveScriptSessionIfChanged(isTextChanged);
+			autosaver->flush();
+			return executeScriptSearch(decodeScriptText(arguments), output);
+		}
+
+		if (editor->getCurrentSession() == nullptr)
+			return "сеанс не був відкритий!";
+
+		std::string error;
+		if (operation == "insert")
+			error = executeScriptInsertion(arguments);
+		else if (operation == "copy" || operation == "cut" || operation == "delete") {
+			CommandType typeOfCommand = operation == "copy" ? CommandType::Copy : operation == "cut" ? CommandType::Cut : CommandType::Delete;
+			error = executeScriptActionByPositions(typeOfCommand, arguments);
+		}
+		else if (operation == "copy-match" || operation == "cut-match" || operation == "delete-match" || operation == "paste-match") {
+			CommandType typeOfCommand = operation == "copy-match" ? CommandType::Copy : operation == "cut-match" ? CommandType::Cut :
+				operation == "delete-match" ? CommandType::Delete : CommandType::Paste;
+			error = executeScriptActionByMatch(typeOfCommand, arguments);
+		}
+		else if (operation == "undo") {
+			if (editor->getCurrentSession()->sizeOfCommandsHistory() == 0 || editor->getCurrentSession()->getCurIndexInCommHistory() == -1)
+				return "немає дій, які можна було б скасувати!";
+			if (!commandsManager->invokeCommand(CommandType::Undo))
+				return "запис історії не вдалося прочитати, тож команду не можна скасувати!";
+		}
+		else if (operation == "redo") {
+			if (!commandsManager->isThereAnyCommandForward())
+				return "немає дій, які можна було б повторити!";
+			if (!commandsManager->invokeCommand(CommandType::Redo))
+				return "запис історії не вдалося прочитати, тож команду не можна повторити!";
+		}
+		else if (operation == "save") {
+			isTextChanged = true;
+			saveScriptSessionIfChanged(isTextChanged);
+			autosaver->flush();
+			return "";
+		}
+		else if (operation == "print") {
+			output += "Зміст файлу " + editor->getCurrentSession()->getName() + ":\n\"" + editor->getCurrentText()->toString() + "\"\n";
+			return "";
+		}
+		else
+			return "невідома операція \"" + operation + "\"!";
+
+		if (error.empty() && operation.compare(0, 4, "copy") != 0)
+			isTextChanged = true;
+		return error;
+	}
 public:
 
+	//виконує сценарій (по одній операції в рядку, # - коментар) і повертає 0, якщо всі операції були успішними:
+	//create|open <ім'я>, insert <позиція> <текст>, copy|cut|delete <початок> <кінець> (позиції - зміщення або рядок:стовпець),
+	//copy-match|cut-match|delete-match <номер входження або *> <текст>, paste-match <номер або *> <шукане>=><текст>,
+	//undo, redo, save, print, search <текст> (у збережених файлах усіх сеансів)
+	int executeScript(std::istream& script) {
+		std::string line, output;
+		size_t numberOfLine = 0, countOfOperations = 0, countOfErrors = 0, sizeOfScript = 0;
+		bool isTextChanged = false;
+
+		editor = new Editor();
+		editor->tryToLoadSessions();
+		commandsManager = new CommandsManager(editor);
+		autosaver = new SessionsAutosaver(FilesManager::getAutosaveCoalescingWindow());
+		metricsReporter = new MetricsReporter(FilesManager::getMetricsReportInterval());
+
+		auto startTime = std::chrono::steady_clock::now();
+		while (getline(script, line)) {
+			numberOfLine++;
+			sizeOfScript += line.size() + 1;
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+			if (line.empty() || line[0] == '#')
+				continue;
+
+			std::string arguments = line;
+			std::string operation = takeScriptToken(arguments);
+			std::string error = executeScriptOperation(operation, arguments, isTextChanged, output);
+
+			countOfOperations++;
+			if (!error.empty()) {
+				countOfErrors++;
+				output += "Рядок " + std::to_string(numberOfLine) + ": помилка: " + error + "\n";
+			}
+		}
+		if (editor->getCurrentSession() != nullptr)
+			saveScriptSessionIfChanged(isTextChanged);
+		autosaver->flush();
+		auto elapsedMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+		delete autosaver;
+		metricsReporter->stop();
+		editor->tryToUnloadSessions();
+		delete metricsReporter;
+		delete commandsManager;
+		delete editor;
+
+		unsigned long long operationsPerSecond = elapsedMicroseconds > 0 ? countOfOperations * 1000000ull / elapsedMicroseconds : 0;
+		output += "Виконано операцій: " + std::to_string(countOfOperations) + " (з помилками: " + std::to_string(countOfErrors) + ")";
+		output += " за " + std::to_string(elapsedMicroseconds) + " мкс, " + std::to_string(operationsPerSecond) + " операцій/с, ";
+		output += "оброблено байтів сценарію: " + std::to_string(sizeOfScript) + "\n";
+		std::cout << output;
+		std::cout.flush();
+
+		return countOfErrors == 0 ? 0 : 1;
+	}
+
 	void executeMainMenu() {
 		int choice;
 		editor = new Editor();
 		editor->tryToLoadSessions();
+		autosaver = new SessionsAutosaver(FilesManager::getAutosaveCoalescingWindow());
+		metricsReporter = new MetricsReporter(FilesManager::getMetricsReportInterval());
 
 		do
 		{
@@ -1226,7 +5858,10 @@ public:
 			{
 			case 0:
 				std::cout << "\nДо побачення!\n";
+				delete autosaver;
+				metricsReporter->stop();
 				editor->tryToUnloadSessions();
+				delete metricsReporter;
 				delete editor;
 				return;
 			case 1:
@@ -1240,17 +5875,64 @@ public:
 				if (doesAnySessionExist())
 					choice == 3 ? executeGettingSessionsMenu() :
 					executeDeletingSessionsMenu();
+				continue;
+			case 5:
+				if (doesAnySessionExist())
+					executeSearchingInAllSessions();
+				continue;
+			case 6:
+				printStatistics();
 			}
 
 		} while (true);
 	}
 };
 
-int main()
+#ifndef EDITOR_BENCHMARK
+int runProgram(int argc, char* argv[])
+{
+	Program program;
+
+	//пакетний режим: Program --script <файл сценарію або "-" для стандартного вводу>
+	if (argc == 3 && std::string(argv[1]) == "--script") {
+		if (std::string(argv[2]) == "-")
+			return program.executeScript(std::cin);
+
+		std::ifstream script(argv[2]);
+		if (!script.is_open()) {
+			std::cout << "Помилка: файл сценарію не вдалося відкрити!\n";
+			return 1;
+		}
+		return program.executeScript(script);
+	}
+
+	ConsoleRenderer::install();
+	program.executeMainMenu();
+	ConsoleRenderer::uninstall();
+	return 0;
+}
+
+int main(int argc, char* argv[])
 {
 	SetConsoleCP(1251);
 	SetConsoleOutputCP(1251);
 
-	Program program;
-	program.executeMainMenu();
-}
\ No newline at end of file
+	//трасування: Program --trace <файл> [--script ...]; події всіх потоків записуються у файл після завершення роботи
+	std::string traceFilepath;
+	if (argc >= 3 && std::string(argv[1]) == "--trace") {
+		traceFilepath = argv[2];
+		Tracer::enable();
+		Tracer::setThreadName("main");
+		argv[2] = argv[0];
+		argc -= 2;
+		argv += 2;
+	}
+
+	int result = runProgram(argc, argv);
+	if (!traceFilepath.empty() && !Tracer::writeTo(traceFilepath)) {
+		std::cout << "Помилка: файл трасування не вдалося записати!\n";
+		return 1;
+	}
+	return result;
+}
+#endif
\ No newline at end of file